@@ -1,92 +1,486 @@
 /* Author: Zach Fukuhara
  *
  * Description:
- * Compress.java is a program that compresses a user defined textfile and
+ * Compress.java is a program that compresses a user defined file and
  * outputs a compressed binary file with the extension .zzz
+ *
+ * Usage: java Compress [-b bits] [-B blocksize] [-c] [file]
+ *   -b  widest code in bits (9-20, default 16)
+ *   -B  write the framed format with blocks of this many bytes (see below)
+ *   -c  write to standard output instead of file.zzz
+ * With no file, or "-", standard input is compressed to standard output, so
+ * Compress can sit in a shell pipe.  Any bytes can be compressed.  The sizes,
+ * time taken and speed in MB/s are reported on standard error.
+ *
+ * The dictionary is a hashed trie: every entry is stored as (code of its
+ * prefix, next byte) -> code, so extending the current prefix by one byte
+ * is a single hash lookup and no strings are built.  Input is read a large
+ * buffer at a time and the codes are packed into another, which are both
+ * reused for the whole file.
+ *
+ * Output is the .zzz v2 format: a five byte header ('Z', 'Z', 'Z', the
+ * version and the widest code in bits) followed by the codes packed most
+ * significant bit first, with the last byte padded out with zero bits.
+ * Codes 0-255 are single bytes, CLEAR (256) throws the dictionary away and
+ * new entries start at 257.  Codes start 9 bits wide and grow a bit each
+ * time the dictionary outgrows them.  Once the dictionary is full the
+ * compression ratio is watched, and CLEAR is sent as soon as it starts to
+ * fall, so a file whose contents change part way through gets a dictionary
+ * built for the new contents.
+ *
+ * CompressBlocks writes the framed v3 format for large files: the input is
+ * cut into blocks that are coded independently, each exactly like a v2 code
+ * stream, on a pool of one thread per core.  The header is 'Z', 'Z', 'Z', 3,
+ * the widest code in bits and the block size (4 bytes).  The coded blocks
+ * follow in order, then the block index, which is the coded and original
+ * size of every block (4 bytes each), and last a 16 byte trailer: where the
+ * index starts (8 bytes), the number of blocks (4 bytes) and 'Z', 'Z', 'Z',
+ * 3.  Decompress can then decode the blocks in parallel, or decode just the
+ * ones covering a range of the original file.
 */
 
 import java.io.*;
+import java.util.ArrayDeque;
+import java.util.concurrent.*;
 public class Compress {
+    static final int VERSION = 2;
+    static final int BLOCKVERSION = 3;
+    static final int BLOCKHEADER = 9;
+    static final int DEFAULTBLOCK = 1 << 20;
+    static final int MINBITS = 9;
+    static final int DEFAULTBITS = 16;
+    static final int MAXBITS = 20; // the decompressor keeps arrays of 1 << MAXBITS entries
+    static final int CLEAR = 256;
+    static final int FIRSTCODE = 257;
+    // Number of input bytes between ratio checks once the dictionary is full
+    static final int CHECKGAP = 10000;
+    // Bytes read from the input, and packed codes written, at a time
+    static final int IOBUF = 1 << 20;
+
     public static void main(String[] args) {
-        Compress("/Users/zachfukuhara/Library/COMP 285/src/TestFile.txt");
+        int maxBits = DEFAULTBITS, blockSize = 0;
+        boolean toStdout = false;
+        String filename = null;
+
+        try {
+            for (int i = 0; i < args.length; i++) {
+                if (args[i].equals("-b") && i + 1 < args.length)
+                    maxBits = Integer.parseInt(args[++i]);
+                else if (args[i].equals("-B") && i + 1 < args.length)
+                    blockSize = Integer.parseInt(args[++i]);
+                else if (args[i].equals("-c"))
+                    toStdout = true;
+                else if (filename == null && (args[i].equals("-") || !args[i].startsWith("-")))
+                    filename = args[i];
+                else {
+                    System.err.println("Usage: java Compress [-b bits] [-B blocksize] [-c] [file]");
+                    System.exit(1);
+                }
+            }
+        }
+        catch (NumberFormatException e) {
+            System.err.println("Usage: java Compress [-b bits] [-B blocksize] [-c] [file]");
+            System.exit(1);
+        }
+        if (maxBits < MINBITS || maxBits > MAXBITS) {
+            System.err.println("Code width must be between " + MINBITS + " and " + MAXBITS + " bits");
+            System.exit(1);
+        }
+        if (blockSize < 0) {
+            System.err.println("Block size must be positive");
+            System.exit(1);
+        }
+
+        boolean pipe = filename == null || filename.equals("-");
+        try {
+            InputStream in = pipe ? System.in : new FileInputStream(filename);
+            OutputStream out = pipe || toStdout ? System.out : new FileOutputStream(filename + ".zzz");
+            long start = System.nanoTime();
+            Totals totals = blockSize > 0 ? compressBlocks(in, out, maxBits, blockSize) : compress(in, out, maxBits);
+            double seconds = (System.nanoTime() - start) / 1e9;
+            in.close();
+            out.close();
+            System.err.printf("%s: %d -> %d bytes (%.1f%%) in %.3f s, %.1f MB/s%n", pipe ? "stdin" : filename,
+                    totals.in, totals.out, totals.in == 0 ? 0.0 : 100.0 * totals.out / totals.in,
+                    seconds, totals.in / 1e6 / seconds);
+        }
+        catch (IOException | InterruptedException | ExecutionException e) {
+            System.err.println("Cannot compress " + (pipe ? "stdin" : filename) + ": " + e);
+            System.exit(1);
+        }
     }
 
     public static void Compress(String filename) {
+        Compress(filename, DEFAULTBITS);
+    }
+
+    public static void Compress(String filename, int maxBits) {
         try {
-            // Verify filename
-            if (filename != null && filename.contains(".txt")) {
+            // Verify filename and code width
+            if (maxBits < MINBITS || maxBits > MAXBITS) {
+                System.err.println("Code width must be between " + MINBITS + " and " + MAXBITS + " bits");
+                return;
+            }
+            if (filename != null) {
+                InputStream in = new FileInputStream(filename);
+                OutputStream out = new FileOutputStream(filename + ".zzz");
+                compress(in, out, maxBits);
+                in.close();
+                out.close();
+            }
+        }
+        catch (IOException e) {
+            System.err.println("Cannot compress " + filename + ": " + e);
+        }
+    }
 
-                // Create BufferedReader and DataOutputStream
-                BufferedReader buf = new BufferedReader(new FileReader(filename));
-                DataOutputStream output = new DataOutputStream(new FileOutputStream(filename + ".zzz"));
+    /*
+     * Compresses filename into the framed v3 format (see the top of the file).
+     *
+     * @param maxBits widest code
+     * @param blockSize number of input bytes coded in each block
+     */
+    public static void CompressBlocks(String filename, int maxBits, int blockSize) {
+        try {
+            // Verify filename, code width and block size
+            if (maxBits < MINBITS || maxBits > MAXBITS) {
+                System.err.println("Code width must be between " + MINBITS + " and " + MAXBITS + " bits");
+                return;
+            }
+            if (blockSize < 1) {
+                System.err.println("Block size must be positive");
+                return;
+            }
+            if (filename != null) {
+                InputStream in = new FileInputStream(filename);
+                OutputStream out = new FileOutputStream(filename + ".zzz");
+                compressBlocks(in, out, maxBits, blockSize);
+                in.close();
+                out.close();
+            }
+        }
+        catch (IOException | InterruptedException | ExecutionException e) {
+            System.err.println("Cannot compress " + filename + ": " + e);
+        }
+    }
 
+    // Bytes read and written by a compression
+    static class Totals {
+        long in, out;
+    }
 
-//---------------------------------------------------INITIALIZE DICTIONARY---------------------------------------------------
+    /*
+     * Compresses everything in in onto out as a v2 file.  Neither stream is
+     * closed.
+     *
+     * @param maxBits widest code
+     * @return bytes read and written
+     */
+    static Totals compress(InputStream in, OutputStream out, int maxBits) throws IOException {
+        out.write(new byte[] {'Z', 'Z', 'Z', VERSION, (byte)maxBits});
+        BitWriter output = new BitWriter(out, IOBUF);
+        Encoder encoder = new Encoder(output, maxBits);
+        byte[] chunk = new byte[IOBUF];
+        int n;
 
-                // Declare a constant for the table size and the ascii counter variable
-                final int TABLESIZE = 17;
-                int asciiCount = 32;
-                int numDictItems;
-                // Create an array of Linked Lists
-                LinkedList[] dictionary = new LinkedList[TABLESIZE];
+        while ((n = in.read(chunk)) != -1)
+            encoder.code(chunk, 0, n);
+        encoder.finish();
+        output.finish();
+        out.flush();
 
-                // Initialize the linked lists in the array
-                for (int i = 0; i < TABLESIZE; i++)
-                    dictionary[i % TABLESIZE] = new LinkedList();
+        Totals totals = new Totals();
+        totals.in = encoder.bytesIn;
+        totals.out = 5 + (output.bits + 7) / 8;
+        return totals;
+    }
 
-                // Insert in the nodes into the dictionary
-                for (numDictItems = 0; numDictItems < 95; numDictItems++) // numDictItems < 95 b/c we have to include the 126th ascii value
-                    dictionary[numDictItems % TABLESIZE].ListInsertAt(1, (short)asciiCount, Character.toString((char)asciiCount++));
+    /*
+     * Compresses everything in in onto out in the framed v3 format.  Neither
+     * stream is closed, and out doesn't need to be seekable.
+     *
+     * @param maxBits widest code
+     * @param blockSize number of input bytes coded in each block
+     * @return bytes read and written
+     */
+    static Totals compressBlocks(InputStream in, OutputStream out, int maxBits, int blockSize)
+            throws IOException, InterruptedException, ExecutionException {
+        DataOutputStream output = new DataOutputStream(new BufferedOutputStream(out, IOBUF));
+        output.write(new byte[] {'Z', 'Z', 'Z', BLOCKVERSION, (byte)maxBits});
+        output.writeInt(blockSize);
 
+        // Blocks are written in order as they finish.  Only two per thread are
+        // read ahead, and their buffers are handed back to be read into again,
+        // so memory use doesn't grow with the file.
+        int threads = Runtime.getRuntime().availableProcessors();
+        ExecutorService pool = Executors.newFixedThreadPool(threads);
+        ArrayDeque<Future<byte[]>> pending = new ArrayDeque<>();
+        ArrayDeque<byte[]> reading = new ArrayDeque<>(); // buffers of the pending blocks
+        ArrayDeque<Integer> sizes = new ArrayDeque<>();
+        ArrayDeque<byte[]> free = new ArrayDeque<>();
+        ByteArrayOutputStream indexBytes = new ByteArrayOutputStream();
+        DataOutputStream index = new DataOutputStream(indexBytes);
+        Totals totals = new Totals();
+        long indexAt = BLOCKHEADER;
+        int blocks = 0;
+        boolean more = true;
 
-                // Insert \t, \r, and \n into the dictionary
-                dictionary[10].ListInsertAt(1, (short)asciiCount++, "\t");
-                dictionary[11].ListInsertAt(1, (short)asciiCount++, "\r");
-                dictionary[12].ListInsertAt(1, (short)asciiCount++, "\n");
-                numDictItems += 3;
+        try {
+            while (true) {
+                while (more && pending.size() < 2 * threads) {
+                    byte[] block = free.isEmpty() ? new byte[blockSize] : free.remove();
+                    int size = fill(in, block);
+                    if (size == 0) {
+                        more = false;
+                        break;
+                    }
+                    pending.add(pool.submit(() -> compressBlock(block, size, maxBits)));
+                    reading.add(block);
+                    sizes.add(size);
+                }
+                if (pending.isEmpty())
+                    break;
+                byte[] coded = pending.remove().get();
+                free.add(reading.remove());
+                int length = sizes.remove();
+                output.write(coded);
+                index.writeInt(coded.length);
+                index.writeInt(length);
+                indexAt += coded.length;
+                totals.in += length;
+                blocks++;
+            }
+        }
+        finally {
+            pool.shutdownNow();
+        }
+
+        output.write(indexBytes.toByteArray());
+        output.writeLong(indexAt);
+        output.writeInt(blocks);
+        output.write(new byte[] {'Z', 'Z', 'Z', BLOCKVERSION});
+        output.flush();
+        totals.out = indexAt + 8L * blocks + 16;
+        return totals;
+    }
+
+    // Codes the first size bytes of block as a v2 code stream with no header
+    static byte[] compressBlock(byte[] block, int size, int maxBits) throws IOException {
+        ByteArrayOutputStream coded = new ByteArrayOutputStream(size / 2 + 16);
+        BitWriter output = new BitWriter(coded, 1 << 16);
+        Encoder encoder = new Encoder(output, maxBits);
+        encoder.code(block, 0, size);
+        encoder.finish();
+        output.finish();
+        return coded.toByteArray();
+    }
+
+    // Reads until block is full or the input ends, and returns the number of bytes read
+    static int fill(InputStream in, byte[] block) throws IOException {
+        int size = 0, n;
+        while (size < block.length && (n = in.read(block, size, block.length - size)) != -1)
+            size += n;
+        return size;
+    }
+
+    /*
+     * The state of one code stream, which is handed the input a buffer at a
+     * time.
+     */
+    static class Encoder {
+
+//---------------------------------------------------INITIALIZE DICTIONARY---------------------------------------------------
+
+        // Single bytes are their own codes, so only longer entries go in the trie
+        private final CodeTable dictionary = new CodeTable();
+        private final BitWriter output;
+        private final int maxBits, limit;
+        private int nextCode = FIRSTCODE;
+        private int prefix = -1;
+        long bytesIn = 0;
+        private long checkAt = CHECKGAP;
+        private long resetIn = 0, resetBits = 0; // input and output so far when the dictionary was last cleared
+        private double lastRatio = 0;
+
+        Encoder(BitWriter output, int maxBits) {
+            this.output = output;
+            this.maxBits = maxBits;
+            this.limit = 1 << maxBits;
+        }
 
 
 //---------------------------------------------------COMPRESSION ALGORITHM---------------------------------------------------
 
-                // STEP 1: Loop through input and find the longest prefix (P) of the uncoded part of the input file that is in the dictionary
-                // STEP 2: Output the code
-                // STEP 3: If there is a next character (C) in the input file, then assign (PC) the next code and insert it into the dictionary
+        // STEP 1: Loop through input and find the longest prefix (P) of the uncoded part of the input file that is in the dictionary
+        // STEP 2: Output the code, as wide as the largest code the decompressor could be expecting
+        // STEP 3: If there is a next byte (C) in the input file, then assign (PC) the next code and insert it into the dictionary
+        // STEP 4: Once the dictionary is full, output CLEAR and start a new one if the ratio has dropped since the last check
 
-                String prefix = "", nextChar;
-                String binStr;
-                boolean inDict = false;
+        // Codes len bytes of data starting at off
+        void code(byte[] data, int off, int len) throws IOException {
+            int prefix = this.prefix, next;
 
+            for (int i = off; i < off + len; i++) {
+                int ch = data[i] & 0xFF;
+                bytesIn++;
 
-                while (buf.ready()) { // while there is 1(+) character(s) in the buffer
-                    nextChar = Character.toString((char)buf.read()); // Store next character from buffer in nextChar
+                if (prefix == -1) // Start of input: the prefix is just this byte
+                    prefix = ch;
+                else if ((next = dictionary.get(prefix, ch)) != -1) // PC is in the dictionary, update longest known prefix
+                    prefix = next;
+                else // PC is not in the dictionary: output P, add PC and start again from C
+                {
+                    output.write(prefix, width(nextCode - 1, maxBits));
+                    if (nextCode < limit)
+                        dictionary.put(prefix, ch, nextCode++);
+                    prefix = ch;
 
-                    for (int i = 0; i < TABLESIZE; i++) { // Check if the dictionary contains the prefix + nextChar
-                        if (inDict = dictionary[i].ContainsKey(prefix + nextChar)) {
-                            inDict = true;
-                            break;
+                    if (nextCode == limit && bytesIn >= checkAt) {
+                        checkAt = bytesIn + CHECKGAP;
+                        double ratio = (double)(bytesIn - resetIn) * 8 / (output.bits - resetBits);
+                        if (ratio < lastRatio) {
+                            output.write(CLEAR, width(nextCode - 1, maxBits));
+                            dictionary.clear();
+                            nextCode = FIRSTCODE;
+                            lastRatio = 0;
+                            resetIn = bytesIn - 1; // ch is already read but still to be coded
+                            resetBits = output.bits;
                         }
+                        else
+                            lastRatio = ratio;
                     }
+                }
+            }
+            this.prefix = prefix;
+        }
 
-                    if (inDict) // If prefix + nextChar is in the dictionary, update longest known prefix
-                        prefix += nextChar;
-                    else // If prefix + nextChar is not in the dictionary, add it and output it.  Then update prefix.
-                    {
-                        dictionary[numDictItems++ % TABLESIZE].ListInsertAt(1, (short)asciiCount++, (prefix + nextChar));
+        // Outputs whatever prefix is left over at the end of the input
+        void finish() throws IOException {
+            if (prefix != -1)
+                output.write(prefix, width(nextCode - 1, maxBits));
+            prefix = -1;
+        }
+    }
 
-                        for(int j = 0; j < TABLESIZE; j++) {
-                            if(dictionary[j].getCode(prefix) != -1) {
-                                output.writeShort((short)dictionary[j].getCode(prefix));
-                            }
-                        }
-                        prefix = nextChar;
-                    }
+    /*
+     * Width in bits to write a code when nextCode is the next free code.  The
+     * decompressor adds each entry one code later than the compressor does, so
+     * it works the width out from its own next free code, which is the
+     * compressor's nextCode - 1.  That is also the largest code that can be
+     * sent, since a prefix can be the entry added just before it.
+     */
+    static int width(int code, int maxBits) {
+        int bits = 32 - Integer.numberOfLeadingZeros(code);
+        return Math.max(MINBITS, Math.min(maxBits, bits));
+    }
+
+    /*
+     * Packs codes most significant bit first into a buffer that is written
+     * out whenever it fills.  Codes are at most MAXBITS wide, so fewer than
+     * MAXBITS + 8 bits are ever pending in an int.
+     */
+    static class BitWriter {
+        private final OutputStream out;
+        private final byte[] bytes;
+        private int used = 0;
+        private int pending = 0;     // bits not in bytes yet, in the low pendingBits bits
+        private int pendingBits = 0;
+        long bits = 0;               // number of code bits written so far
+
+        BitWriter(OutputStream out, int size) {
+            this.out = out;
+            this.bytes = new byte[size];
+        }
+
+        void write(int code, int width) throws IOException {
+            pending = (pending << width) | code;
+            pendingBits += width;
+            bits += width;
+            while (pendingBits >= 8) {
+                pendingBits -= 8;
+                if (used == bytes.length) {
+                    out.write(bytes, 0, used);
+                    used = 0;
                 }
-                buf.close();
-                output.close();
+                bytes[used++] = (byte)(pending >>> pendingBits);
             }
+            pending &= (1 << pendingBits) - 1;
         }
-        catch (IOException e) {
-            System.out.println("IOException e");
+
+        // Pads the last byte with zero bits and writes out the buffer.  The
+        // stream is left open.
+        void finish() throws IOException {
+            if (pendingBits > 0)
+                write(0, 8 - pendingBits);
+            out.write(bytes, 0, used);
+            used = 0;
+        }
+    }
+
+    /*
+     * Open addressing hash table from (prefix code, next byte) to the code of
+     * the entry they make.  The pair is packed into one long key and the
+     * table doubles before it gets half full, so lookups rarely probe more
+     * than a slot or two.
+     */
+    static class CodeTable {
+        private long[] keys = new long[1 << 12];
+        private int[] codes = new int[1 << 12];
+        private int size = 0;
+
+        CodeTable() {
+            java.util.Arrays.fill(keys, -1);
+        }
+
+        // Returns the code for prefix + ch, or -1 if it isn't in the table
+        int get(int prefix, int ch) {
+            long key = ((long)prefix << 16) | ch;
+            int mask = keys.length - 1;
+            for (int slot = hash(key) & mask; keys[slot] != -1; slot = (slot + 1) & mask) {
+                if (keys[slot] == key)
+                    return codes[slot];
+            }
+            return -1;
+        }
+
+        // Adds prefix + ch with the given code (it must not already be there)
+        void put(int prefix, int ch, int code) {
+            if (2 * (size + 1) > keys.length)
+                grow();
+            insert(((long)prefix << 16) | ch, code);
+            size++;
+        }
+
+        // Empties the table, keeping its size since it will fill up again
+        void clear() {
+            java.util.Arrays.fill(keys, -1);
+            size = 0;
+        }
+
+        private void insert(long key, int code) {
+            int mask = keys.length - 1;
+            int slot = hash(key) & mask;
+            while (keys[slot] != -1)
+                slot = (slot + 1) & mask;
+            keys[slot] = key;
+            codes[slot] = code;
+        }
+
+        private void grow() {
+            long[] oldKeys = keys;
+            int[] oldCodes = codes;
+            keys = new long[oldKeys.length * 2];
+            codes = new int[oldCodes.length * 2];
+            java.util.Arrays.fill(keys, -1);
+            for (int i = 0; i < oldKeys.length; i++) {
+                if (oldKeys[i] != -1)
+                    insert(oldKeys[i], oldCodes[i]);
+            }
+        }
+
+        private static int hash(long key) {
+            key *= 0x9E3779B97F4A7C15L;
+            return (int)(key >>> 32);
         }
     }
 }
@@ -2,13 +2,112 @@
  *
  * Description:
  * Decompress.java is a program that decompresses a user-defined compressed binary
- * file with the extension .zzz and outputs a textfile
+ * file with the extension .zzz and outputs the original file
+ *
+ * Usage: java Decompress [-c] [-x start length] [file]
+ *   -c  write to standard output instead of Output.txt
+ *   -x  only write length bytes of the original, starting at byte start
+ *       (framed files only)
+ * With no file, or "-", standard input is decompressed to standard output,
+ * so Decompress can sit in a shell pipe.  The size, time taken and speed in
+ * MB/s are reported on standard error.
+ *
+ * The dictionary is an array indexed by code.  Each entry holds the code of
+ * its prefix, its last byte, its first byte and its length, so a code is
+ * expanded by walking back through its prefixes straight into the output
+ * buffer and no strings are built.  Input is read a large buffer at a time
+ * and output is written a large buffer at a time, and both are reused for
+ * the whole file.
+ *
+ * Both .zzz formats are read.  v2 files (see Compress.java) start with
+ * 'Z', 'Z', 'Z', the version and the widest code in bits.  v1 files have no
+ * header and are plain 16-bit codes for text, with printable ascii as its own
+ * code (32-126) followed by \t, \r and \n; their first code is a single
+ * character, so they always start with a zero byte.  The original Compress
+ * never wrote out the prefix it was holding when the input ended, so its
+ * files decode to the same text the original Decompress gave, which is
+ * missing those last few characters (zzz-corpus/records-v1.zzz is meant to
+ * be such a file, checked by RoundTrip, but is synthetic: it was produced by
+ * a Python transcription of the original Compress rather than by the Java).
+ *
+ * Framed v3 files (see Compress.CompressBlocks) are decoded a block per
+ * thread, and Extract pulls a range of bytes out of one by decoding only the
+ * blocks that cover it.  Both need the block index at the end of the file,
+ * so framed files can't be read from a pipe.
 */
 
 import java.io.*;
+import java.util.ArrayDeque;
+import java.util.concurrent.*;
 public class Decompress {
+    // Must match Compress
+    static final int BLOCKVERSION = 3;
+    static final int BLOCKHEADER = 9;
+    static final int MINBITS = 9;
+    static final int MAXBITS = 20;
+    static final int CLEAR = 256;
+    static final int FIRSTCODE = 257;
+    // Every 16-bit code in a v1 file
+    static final int V1CODES = 65536;
+    // Bytes read from the input, and decoded bytes written, at a time
+    static final int IOBUF = 1 << 20;
+    static final int OUTBUF = 1 << 16;
+
     public static void main(String[] args) {
-        Decompress("TestFile.txt.zzz");
+        boolean toStdout = false, extract = false;
+        long start = 0, length = 0;
+        String filename = null;
+
+        try {
+            for (int i = 0; i < args.length; i++) {
+                if (args[i].equals("-c"))
+                    toStdout = true;
+                else if (args[i].equals("-x") && i + 2 < args.length) {
+                    extract = true;
+                    start = Long.parseLong(args[++i]);
+                    length = Long.parseLong(args[++i]);
+                }
+                else if (filename == null && (args[i].equals("-") || !args[i].startsWith("-")))
+                    filename = args[i];
+                else {
+                    System.err.println("Usage: java Decompress [-c] [-x start length] [file]");
+                    System.exit(1);
+                }
+            }
+        }
+        catch (NumberFormatException e) {
+            System.err.println("Usage: java Decompress [-c] [-x start length] [file]");
+            System.exit(1);
+        }
+        if (start < 0 || length < 0) {
+            System.err.println("Start and length cannot be negative");
+            System.exit(1);
+        }
+
+        boolean pipe = filename == null || filename.equals("-");
+        if (extract && pipe) {
+            System.err.println("-x needs a framed .zzz file, not standard input");
+            System.exit(1);
+        }
+        try {
+            OutputStream out = pipe || toStdout ? System.out : new FileOutputStream("Output.txt");
+            long began = System.nanoTime(), written;
+            if (extract)
+                written = decodeBlocks(filename, out, start, length);
+            else {
+                InputStream in = pipe ? System.in : new FileInputStream(filename);
+                written = decompress(in, out, pipe ? null : filename);
+                in.close();
+            }
+            double seconds = (System.nanoTime() - began) / 1e9;
+            out.close();
+            System.err.printf("%s: %d bytes in %.3f s, %.1f MB/s%n", pipe ? "stdin" : filename,
+                    written, seconds, written / 1e6 / seconds);
+        }
+        catch (IOException | InterruptedException | ExecutionException ex) {
+            System.err.println("Cannot decompress " + (pipe ? "stdin" : filename) + ": " + ex.getMessage());
+            System.exit(1);
+        }
     }
 
     public static void Decompress(String filename)
@@ -17,88 +116,363 @@ public class Decompress {
         {
             if (filename != null && filename.contains(".zzz"))
             {
-                DataInputStream input = new DataInputStream(new FileInputStream(filename));
-                BufferedWriter buf = new BufferedWriter(new FileWriter("Output.txt"));
+                InputStream input = new FileInputStream(filename);
+                OutputStream buf = new FileOutputStream("Output.txt");
+                decompress(input, buf, filename);
+                buf.close();
+                input.close();
+            }
+        }
+        catch (IOException | InterruptedException | ExecutionException ex) {
+            System.err.println("EX " + ex.getMessage());
+        }
+    }
+
+    /*
+     * Writes length bytes of the original file, starting at byte start, from a
+     * framed v3 file into Output.txt.  Only the blocks holding those bytes are
+     * read and decoded.
+     */
+    public static void Extract(String filename, long start, long length)
+    {
+        try
+        {
+            if (start < 0 || length < 0) {
+                System.err.println("Start and length cannot be negative");
+                return;
+            }
+            if (filename != null && filename.contains(".zzz"))
+            {
+                OutputStream buf = new FileOutputStream("Output.txt");
+                decodeBlocks(filename, buf, start, length);
+                buf.close();
+            }
+        }
+        catch (IOException | InterruptedException | ExecutionException ex) {
+            System.err.println("EX " + ex.getMessage());
+        }
+    }
 
+    /*
+     * Decompresses a .zzz file of any version from input onto buf.  Neither
+     * stream is closed.
+     *
+     * @param filename the file input reads, which framed files are reopened
+     *      from, or null if it isn't a file
+     * @return number of bytes written
+     */
+    static long decompress(InputStream input, OutputStream buf, String filename)
+            throws IOException, InterruptedException, ExecutionException {
+        BufferedInputStream in = new BufferedInputStream(input, IOBUF);
+
+        in.mark(5);
+        if (in.read() == 'Z' && in.read() == 'Z' && in.read() == 'Z') {
+            int version = in.read(), maxBits = in.read();
+            if ((version != 2 && version != BLOCKVERSION) || maxBits < MINBITS || maxBits > MAXBITS)
+                throw new IOException("unsupported .zzz version " + version + " with " + maxBits + " bit codes");
+            if (version == 2)
+                return decodeV2(new BitReader(in), buf, maxBits);
+            if (filename == null)
+                throw new IOException("framed .zzz files can only be read from a file, not a pipe");
+            return decodeBlocks(filename, buf, 0, -1);
+        }
+        in.reset();
+        return decodeV1(new BitReader(in), buf);
+    }
+
+    /*
+     * Decodes the blocks of a framed v3 file that hold bytes start to
+     * start + length - 1 of the original, one per thread, and writes those
+     * bytes to buf in order.
+     *
+     * @param length number of bytes to write, or -1 for everything after start
+     * @return number of bytes written
+     */
+    static long decodeBlocks(String filename, OutputStream buf, long start, long length)
+            throws IOException, InterruptedException, ExecutionException {
+        RandomAccessFile file = new RandomAccessFile(filename, "r");
+        try {
+            // Header and trailer
+            int magic = 'Z' << 24 | 'Z' << 16 | 'Z' << 8 | BLOCKVERSION;
+            if (file.length() < BLOCKHEADER + 16 || file.readInt() != magic)
+                throw new IOException(filename + " is not a framed .zzz file");
+            int maxBits = file.read();
+            if (maxBits < MINBITS || maxBits > MAXBITS)
+                throw new IOException("unsupported code width " + maxBits);
+            file.seek(file.length() - 16);
+            long indexAt = file.readLong();
+            int blocks = file.readInt();
+            if (file.readInt() != magic || blocks < 0
+                    || indexAt + 8L * blocks != file.length() - 16)
+                throw new IOException(filename + " has no block index");
+
+            // Block i is bytes codedAt[i] to codedAt[i + 1] - 1 of the file and
+            // bytes textAt[i] to textAt[i + 1] - 1 of the original
+            byte[] raw = new byte[8 * blocks];
+            file.seek(indexAt);
+            file.readFully(raw);
+            DataInputStream index = new DataInputStream(new ByteArrayInputStream(raw));
+            long[] codedAt = new long[blocks + 1];
+            long[] textAt = new long[blocks + 1];
+            codedAt[0] = BLOCKHEADER;
+            for (int i = 0; i < blocks; i++) {
+                int codedSize = index.readInt(), size = index.readInt();
+                if (codedSize < 0 || size < 0)
+                    throw new IOException(filename + " has a bad block index");
+                codedAt[i + 1] = codedAt[i] + codedSize;
+                textAt[i + 1] = textAt[i] + size;
+            }
+            if (codedAt[blocks] != indexAt)
+                throw new IOException(filename + " has a bad block index");
+
+            long end = length == -1 || length > textAt[blocks] - start ? textAt[blocks] : start + length;
+            int first = 0;
+            while (first < blocks && textAt[first + 1] <= start)
+                first++;
+
+            // Blocks are written in order as they finish, with two per thread
+            // read ahead
+            int threads = Runtime.getRuntime().availableProcessors();
+            ExecutorService pool = Executors.newFixedThreadPool(threads);
+            ArrayDeque<Future<byte[]>> pending = new ArrayDeque<>();
+            long written = 0;
+            try {
+                int next = first;
+                for (int block = first; block < blocks && textAt[block] < end; block++) {
+                    while (next < blocks && textAt[next] < end && pending.size() < 2 * threads) {
+                        byte[] coded = new byte[(int)(codedAt[next + 1] - codedAt[next])];
+                        int size = (int)(textAt[next + 1] - textAt[next]);
+                        file.seek(codedAt[next]);
+                        file.readFully(coded);
+                        pending.add(pool.submit(() -> decodeBlock(coded, size, maxBits)));
+                        next++;
+                    }
+                    // Trim the first and last blocks to the range
+                    byte[] text = pending.remove().get();
+                    int from = (int)Math.max(0, start - textAt[block]);
+                    int to = (int)Math.min(text.length, end - textAt[block]);
+                    buf.write(text, from, to - from);
+                    written += to - from;
+                }
+            }
+            finally {
+                pool.shutdownNow();
+            }
+            buf.flush();
+            return written;
+        }
+        finally {
+            file.close();
+        }
+    }
+
+    // Decodes one block of a framed file, which should come to size bytes
+    static byte[] decodeBlock(byte[] coded, int size, int maxBits) throws IOException {
+        ByteArrayOutputStream text = new ByteArrayOutputStream(size);
+        decodeV2(new BitReader(coded), text, maxBits);
+        if (text.size() != size)
+            throw new IOException("block decodes to " + text.size() + " bytes instead of " + size);
+        return text.toByteArray();
+    }
+
+    /*
+     * Decodes a v2 code stream: variable width codes and CLEAR.
+     *
+     * @return number of bytes written
+     */
+    static long decodeV2(BitReader input, OutputStream buf, int maxBits) throws IOException {
 
 //---------------------------------------------------INITIALIZE DICTIONARY---------------------------------------------------
 
-                // Declare a constant for the table size and the ascii counter variable
-                final int TABLESIZE = 17;
-                int asciiCount = 32;
-                int numDictItems;
-                // Create an array of Linked Lists
-                LinkedList[] dictionary = new LinkedList[TABLESIZE];
+        int limit = 1 << maxBits;
+        int[] prefixOf = new int[limit];
+        byte[] lastByte = new byte[limit];
+        byte[] firstByte = new byte[limit];
+        int[] length = new int[limit];
+
+        // Single bytes are their own codes.  CLEAR only resets nextCode: entries
+        // at or past it are never read before they are written again.
+        for (int c = 0; c < 256; c++)
+            addEntry(prefixOf, lastByte, firstByte, length, c, -1, (byte)c);
+        int nextCode = FIRSTCODE;
+
+
+//--------------------------------------------------DECOMPRESSION ALGORITHM--------------------------------------------------
+
+        byte[] text = new byte[Math.max(OUTBUF, limit + 1)]; // no entry is longer than the number of codes
+        int used = 0;
+        long written = 0;
+        int current, previous = -1;
 
-                // Initialize the linked lists in the array
-                for (int i = 0; i < TABLESIZE; i++)
-                    dictionary[i % TABLESIZE] = new LinkedList();
+        while ((current = input.read(width(nextCode, maxBits))) != -1) {
 
-                // Insert in the nodes into the dictionary
-                for (numDictItems = 0; numDictItems < 95; numDictItems++) // numDictItems < 95 b/c we have to include the 126th ascii value
-                    dictionary[numDictItems % TABLESIZE].ListInsertAt(1, (short)asciiCount, Character.toString((char)asciiCount++));
+            if (current == CLEAR) {
+                nextCode = FIRSTCODE;
+                previous = -1;
+                continue;
+            }
+            if (previous == -1) {
+                // first code since the start or a CLEAR: a single byte, and nothing to add yet
+                if (current >= CLEAR)
+                    throw new IOException("bad code " + current);
+            }
+            else if (current < nextCode) {
+                // current is in the dictionary: add previous + its first byte
+                if (nextCode < limit)
+                    addEntry(prefixOf, lastByte, firstByte, length, nextCode++, previous, firstByte[current]);
+            }
+            else if (current == nextCode && nextCode < limit) {
+                // current is the entry being made right now: previous + previous's first byte
+                addEntry(prefixOf, lastByte, firstByte, length, nextCode++, previous, firstByte[previous]);
+            }
+            else
+                throw new IOException("bad code " + current);
+
+            if (used + length[current] > text.length) {
+                buf.write(text, 0, used);
+                written += used;
+                used = 0;
+            }
+            used += expand(current, prefixOf, lastByte, length, text, used);
+            previous = current;
+        }
+        buf.write(text, 0, used);
+        buf.flush();
+        return written + used;
+    }
+
+    /*
+     * Decodes a v1 file: 16-bit codes over the printable ascii seed set.
+     *
+     * @return number of bytes written
+     */
+    static long decodeV1(BitReader input, OutputStream buf) throws IOException {
+
+//---------------------------------------------------INITIALIZE DICTIONARY---------------------------------------------------
 
+        int[] prefixOf = new int[V1CODES];
+        byte[] lastByte = new byte[V1CODES];
+        byte[] firstByte = new byte[V1CODES];
+        int[] length = new int[V1CODES];
 
-                // Insert \t, \r, and \n into the dictionary
-                dictionary[10].ListInsertAt(1, (short)asciiCount++, "\t");
-                dictionary[11].ListInsertAt(1, (short)asciiCount++, "\r");
-                dictionary[12].ListInsertAt(1, (short)asciiCount++, "\n");
-                numDictItems += 3;
+        // Single characters: printable ascii is its own code (32-126),
+        // then \t, \r and \n
+        int asciiCount = 32;
+        for (int c = 32; c < 127; c++)
+            addEntry(prefixOf, lastByte, firstByte, length, asciiCount++, -1, (byte)c);
+        addEntry(prefixOf, lastByte, firstByte, length, asciiCount++, -1, (byte)'\t');
+        addEntry(prefixOf, lastByte, firstByte, length, asciiCount++, -1, (byte)'\r');
+        addEntry(prefixOf, lastByte, firstByte, length, asciiCount++, -1, (byte)'\n');
 
 
 //--------------------------------------------------DECOMPRESSION ALGORITHM--------------------------------------------------
 
-                short current = -1, previous = -1;
-                String keyPrev = "", keyCur = "";
-                boolean inDict = false;
+        byte[] text = new byte[V1CODES + 1]; // no entry is longer than the number of codes
+        int used = 0;
+        long written = 0;
+        int current, previous = -1;
 
+        while ((current = input.read(16)) != -1) {
 
-                previous = input.readShort();
+            if (previous == -1) {
+                // first code: a single character
+                if (current >= asciiCount || length[current] == 0)
+                    throw new IOException("bad code " + current);
+            }
+            else if (current < asciiCount && length[current] != 0) {
+                // current is in the dictionary: add previous + its first character
+                if (asciiCount < V1CODES)
+                    addEntry(prefixOf, lastByte, firstByte, length, asciiCount++, previous, firstByte[current]);
+            }
+            else if (current == asciiCount && asciiCount < V1CODES) {
+                // current is the entry being made right now: previous + previous's first character
+                addEntry(prefixOf, lastByte, firstByte, length, asciiCount++, previous, firstByte[previous]);
+            }
+            else
+                throw new IOException("bad code " + current);
 
-                for (int i = 0; i < TABLESIZE; i++) {
-                    if (dictionary[i].getKey(previous) != null)
-                    {
-                        keyPrev = dictionary[i].getKey(previous);
-                    }
-                }
+            if (used + length[current] > text.length) {
+                buf.write(text, 0, used);
+                written += used;
+                used = 0;
+            }
+            used += expand(current, prefixOf, lastByte, length, text, used);
+            previous = current;
+        }
+        buf.write(text, 0, used);
+        buf.flush();
+        return written + used;
+    }
 
-                buf.write(keyPrev, 0, keyPrev.length());
+    // Width of the next v2 code: Compress.width of the largest code that can
+    // come next, which is the entry about to be made
+    static int width(int nextCode, int maxBits) {
+        int bits = 32 - Integer.numberOfLeadingZeros(nextCode);
+        return Math.max(MINBITS, Math.min(maxBits, bits));
+    }
+
+    // Adds code as prefix + ch (prefix -1 for a single byte)
+    static void addEntry(int[] prefixOf, byte[] lastByte, byte[] firstByte, int[] length, int code, int prefix, byte ch) {
+        prefixOf[code] = prefix;
+        lastByte[code] = ch;
+        firstByte[code] = prefix == -1 ? ch : firstByte[prefix];
+        length[code] = prefix == -1 ? 1 : length[prefix] + 1;
+    }
 
-                while(input.available() > 0) { // while the dataInputStream has content remaining
+    // Writes the bytes of code into text starting at off and returns how many there are
+    static int expand(int code, int[] prefixOf, byte[] lastByte, int[] length, byte[] text, int off) {
+        int len = length[code];
+        for (int i = off + len - 1; i >= off; i--) {
+            text[i] = lastByte[code];
+            code = prefixOf[code];
+        }
+        return len;
+    }
 
-                    current = input.readShort();
+    /*
+     * Unpacks codes written most significant bit first by Compress.BitWriter,
+     * either from a stream a buffer at a time or from an array already in
+     * memory.
+     */
+    static class BitReader {
+        private final InputStream in; // null when reading an array
+        private final byte[] bytes;
+        private int pos = 0, end;
+        private int pending = 0;      // bits read but not used yet, in the low pendingBits bits
+        private int pendingBits = 0;
 
-                    for (int k = 0; k < TABLESIZE; k++) { // Check if the dictionary contains current
-                        if (inDict = dictionary[k].ContainsCode(current)) {
-                            inDict = true;
-                            break;
-                        }
-                    }
+        BitReader(InputStream in) {
+            this.in = in;
+            this.bytes = new byte[IOBUF];
+            this.end = 0;
+        }
 
-                    // Calculate the keys corresponding to [previous] and [current]
-                    for (int j = 0; j < TABLESIZE; j++) {
-                        if (dictionary[j].getKey(previous) != null)
-                            keyPrev = dictionary[j].getKey(previous);
-                        if (dictionary[j].getKey(current) != null)
-                            keyCur = dictionary[j].getKey(current);
-                    }
+        BitReader(byte[] coded) {
+            this.in = null;
+            this.bytes = coded;
+            this.end = coded.length;
+        }
 
-                    if (inDict) {
-                        buf.write(keyCur, 0, keyCur.length());
-                        dictionary[numDictItems++ % TABLESIZE].ListInsertAt(1, (short)asciiCount++, keyPrev + keyCur.substring(0, 1));
-                    }
-                    else {
-                        buf.write(keyPrev + keyPrev.substring(0, 1), 0, keyPrev.length() + 1);
-                        dictionary[numDictItems++ % TABLESIZE].ListInsertAt(1, (short)asciiCount++, keyPrev + keyPrev.substring(0, 1));
-                    }
-                    previous = current;
+        // Returns the next width bit code, or -1 at the end of the input.  The
+        // padding in the last byte of a v2 stream is under 8 bits, so it is
+        // never a code.
+        int read(int width) throws IOException {
+            while (pendingBits < width) {
+                if (pos == end) {
+                    int n = in == null ? -1 : in.read(bytes, 0, bytes.length);
+                    if (n == -1)
+                        return -1;
+                    pos = 0;
+                    end = n;
+                    continue;
                 }
-                buf.close();
-                input.close();
+                pending = (pending << 8) | (bytes[pos++] & 0xFF);
+                pendingBits += 8;
             }
-        }
-        catch (IOException ex) {
-            System.out.println("EX");
+            pendingBits -= width;
+            int code = pending >>> pendingBits & ((1 << width) - 1);
+            pending &= (1 << pendingBits) - 1;
+            return code;
         }
     }
 }
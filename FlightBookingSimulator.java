@@ -1,205 +1,206 @@
 /* Author: Zach Fukuhara <zfukuhara@sandiego.edu>
  *
- * Description:  This program implements of slightly modified Dijkstra's Algorithm
- * to simulate a Flight Booking Website.  Users enter a textfile with a list of cities,
+ * Description:  This program implements Dijkstra's Algorithm to simulate a
+ * Flight Booking Website.  Users enter a textfile with a list of cities,
  * along with a textfile listing the flights available between those cities.  From there,
  * users can enter a departure city and destination, and the program will out the
  * cheapest flight path between those cities.  Note: The program could be modified to
  * output the fastest flight path, assuming the user supplied information about flights
  * durations in an input textfile.
+ *
+ * Usage: java FlightBookingSimulator [cityFile flightFile [options]]
+ *        java FlightBookingSimulator -bench cities flightsPerCity queries [-threads n]
+ * The files are asked for if they aren't given.  They are read once into a
+ * FlightSimGraph, and every reservation after that is a search over it.
+ * Options:
+ *   -batch pairsFile    price every "from, to" line of pairsFile instead of
+ *                       taking reservations (see FlightSimBatch)
+ *   -precompute table   work out the cheapest fare between every pair of
+ *                       cities and save it to table (see FlightSimFares)
+ *   -fares table        price -batch trips from a saved table (not with
+ *                       -precompute, which prices them from the new one)
+ *   -threads n          threads for -batch, -precompute and -bench (default:
+ *                       one per core)
+ * -bench times all of this on a random network.
  */
 
 import java.io.*;
 import java.util.*;
+import java.util.concurrent.ExecutionException;
 public class FlightBookingSimulator
 {
     public static void main(String[] args)
     {
         //---------------------------------------------------------Read In Test Files--------------------------------------------------------
         Scanner keyboard = new Scanner(System.in);
+        String cityFile, flightFile;
+        String batchFile = null, precomputeFile = null, faresFile = null;
+        int threads = Runtime.getRuntime().availableProcessors();
 
-        System.out.println("Please enter a cityFile in the format '________.txt'");
-        String cityFile = keyboard.nextLine().trim();
-        System.out.println("Please enter a flightFile in the format '________.txt'");
-        String flightFile = keyboard.nextLine().trim();
-        System.out.println("Welcome to USAir!");
-        while(true)
+        try
         {
-            try
+            for(int i = args.length >= 2 && !args[0].equals("-bench") ? 2 : 0; i < args.length; i++)
             {
-                //--------------------------------------Initialize Flight Map & Read In User Flight Info--------------------------------------
-
-                BufferedReader cityBuf = new BufferedReader(new FileReader(cityFile));
-                BufferedReader flightBuf = new BufferedReader(new FileReader(flightFile));
-
-                System.out.println("\nWould you like to make flight reservations? (Y/N)");
-                String userResponse = keyboard.nextLine().trim();
-                if(!(userResponse.equalsIgnoreCase("Y") || userResponse.equalsIgnoreCase("Yes")))
+                if(args[i].equals("-batch") && i + 1 < args.length)
+                    batchFile = args[++i];
+                else if(args[i].equals("-precompute") && i + 1 < args.length)
+                    precomputeFile = args[++i];
+                else if(args[i].equals("-fares") && i + 1 < args.length)
+                    faresFile = args[++i];
+                else if(args[i].equals("-threads") && i + 1 < args.length)
+                    threads = Math.max(1, Integer.parseInt(args[++i]));
+                else if(args[i].equals("-bench") && i + 3 < args.length)
                 {
-                    System.out.println("Goodbye!");
-                    break;
+                    int numCities = Integer.parseInt(args[++i]);
+                    int flightsPerCity = Integer.parseInt(args[++i]);
+                    int queries = Integer.parseInt(args[++i]);
+                    if(i + 2 < args.length && args[i + 1].equals("-threads"))
+                        threads = Math.max(1, Integer.parseInt(args[i + 2]));
+                    FlightSimBatch.benchmark(numCities, flightsPerCity, queries, threads);
+                    return;
                 }
-
-                ArrayList<City> cities = new ArrayList<City>();
-                StringTokenizer temp;
-                String tempDepartureCity, tempDestination;
-                String userDepartureCity, userDestination;
-                int tempTicketPrice;
-
-                // Read in the cities
-                while(cityBuf.ready())
-                    cities.add(new City(cityBuf.readLine()));
-                
-                // Read in the departing flights from each city
-                while(flightBuf.ready())
+                else
                 {
-                    temp = new StringTokenizer(flightBuf.readLine(), ",");
-                    tempDepartureCity = temp.nextToken();
-                    tempDestination = temp.nextToken().trim();
-                    tempTicketPrice = Integer.parseInt(temp.nextToken().trim());
-
-                    int index = getCityIndex(cities, 0, cities.size() - 1, tempDepartureCity);
-                    if(index != -1)
-                        cities.get(index).addFlight(getCity(cities, 0, cities.size() - 1, tempDestination), tempTicketPrice);
-                }
-
-                for (int i = 0; i < cities.size(); i++) {
-                    System.out.println(cities.get(i).getCityName());
-                    for (int j = 0; j < cities.get(i).getFlights().size(); j++) {
-                        System.out.println(cities.get(i).getCityName() + "'s flight destination: " + cities.get(i).getFlights().get(j).getDestination().getCityName());
-                        System.out.println("Ticket price: " + cities.get(i).getFlights().get(j).getTicketPrice());
-                    }
+                    System.out.println("Usage: java FlightBookingSimulator [cityFile flightFile [-batch pairsFile] [-precompute table] [-fares table] [-threads n]]");
+                    System.out.println("       java FlightBookingSimulator -bench cities flightsPerCity queries [-threads n]");
+                    return;
                 }
+            }
+        }
+        catch (IllegalArgumentException | InterruptedException | ExecutionException ex)
+        {
+            System.out.println("Error: " + ex);
+            return;
+        }
+        if(faresFile != null && batchFile == null)
+        {
+            System.out.println("Error: -fares only prices -batch trips");
+            return;
+        }
+        if(faresFile != null && precomputeFile != null)
+        {
+            System.out.println("Error: -fares and -precompute can't be used together");
+            return;
+        }
 
-                // Read in user's flight details (departure city & destination)
-                System.out.println("Please enter the city you wish to depart from: ");
-                userDepartureCity = keyboard.nextLine().trim();
-                System.out.println("Please enter the city you wish to travel to: ");
-                userDestination = keyboard.nextLine().trim();
-
-                //---------------------------------------------Verify User Flight Info---------------------------------------------
-
-                boolean checkValidDepartCity = false, checkValidDest = false;
-
-                // Check if userDepartureCity is valid
-                if(getCityIndex(cities, 0, cities.size() - 1, userDepartureCity) != -1)
-                    checkValidDepartCity = true;
-                if(getCityIndex(cities, 0, cities.size() - 1, userDestination) != -1)
-                    checkValidDest = true;
-
-                // If the userDepartureCity or userDestination are invalid, restart
-                if(!checkValidDepartCity)
-                {
-                    System.out.println("Error: Invalid departure city.  Please try again.");
-                    continue;
-                }
-                if(!checkValidDest)
-                {
-                    System.out.println("\nResquest is to fly from " + userDepartureCity + " to " + userDestination + ".\n"
-                                             + "Sorry.  USAir does not serve " + userDestination + ".");
-                    continue;
-                }
+        if(args.length >= 2)
+        {
+            cityFile = args[0];
+            flightFile = args[1];
+        }
+        else
+        {
+            System.out.println("Please enter a cityFile in the format '________.txt'");
+            cityFile = keyboard.nextLine().trim();
+            System.out.println("Please enter a flightFile in the format '________.txt'");
+            flightFile = keyboard.nextLine().trim();
+        }
 
-                //-------------------------------------------Begin Cheapest Flight Path Algorithm-------------------------------------------
+        //--------------------------------------------------------Initialize Flight Map--------------------------------------------------------
 
-                Queue q = new Queue();
-                City visitedCity, adjacentCity = null, startingCity;
-                int minPrice = 0, tempPrice = 0;
-                startingCity = getCity(cities, 0, cities.size() - 1, userDepartureCity);
-                startingCity.setCostToGetHere(0);
-                q.enqueue(startingCity);
+        FlightSimGraph graph;
+        try
+        {
+            graph = FlightSimGraph.load(cityFile, flightFile);
+        }
+        catch (IOException ex)
+        {
+            System.out.println("Error: Invalid file(s).  " + ex.getMessage());
+            return;
+        }
 
-                while(!q.isEmpty())
-                {
-                    visitedCity = q.dequeue();
-                    visitedCity.setVisited(true);
-                    for(int i = 0; i < visitedCity.getFlights().size(); i++)
-                    {
-                        adjacentCity = visitedCity.getFlights().get(i).getDestination();
-
-                        if(!adjacentCity.wasVisited())
-                        {
-                            if(adjacentCity.getCostToGetHere() > visitedCity.getCostToGetHere() + visitedCity.getFlights().get(i).getTicketPrice())
-                            {
-                                adjacentCity.setCostToGetHere(visitedCity.getCostToGetHere() + visitedCity.getFlights().get(i).getTicketPrice());
-                                adjacentCity.setParent(visitedCity);
-                                q.enqueue(adjacentCity);
-                            }
-                        }
-                    }
-                }
+        //-----------------------------------------------Precomputed Fares & Batch Pricing-----------------------------------------------
 
-                //-----------------------------------------Begin Cheapest Flight Path Reconstruction-----------------------------------------
-                if(getCity(cities, 0, cities.size() - 1, userDestination).getCostToGetHere() != 1000000000)
+        if(precomputeFile != null || batchFile != null)
+        {
+            try
+            {
+                FlightSimFares fares = null;
+                if(precomputeFile != null)
                 {
-                    ArrayList<City> flightPath = new ArrayList<City>();
-                    City tempCity = getCity(cities, 0, cities.size() - 1, userDestination);
-
-                    while(tempCity.getParent() != null)
-                    {
-                        flightPath.add(tempCity);
-                        tempCity = tempCity.getParent();
-                    }
-                    flightPath.add(getCity(cities, 0, cities.size() - 1, userDepartureCity));
-                    System.out.println("\nResquest is to fly from " + userDepartureCity + " to " + userDestination + ".");
-                    for(int i = flightPath.size() - 1; i > 0; i--)
-                    {
-                        System.out.println("Flight from " + flightPath.get(i).getCityName() + " to " + flightPath.get(i - 1).getCityName()
-                                         + "\tCost: $" + getTicketPrice(flightPath.get(i).getFlights(), flightPath.get(i - 1)));
-                    }
-                    System.out.println("Total Cost................... $" + getCity(cities, 0, cities.size() - 1, userDestination).getCostToGetHere());
+                    long start = System.nanoTime();
+                    fares = FlightSimFares.precompute(graph, threads);
+                    fares.save(precomputeFile);
+                    System.err.printf("Fares between %d cities saved to %s in %.3f s%n", graph.getNumCities(),
+                            precomputeFile, (System.nanoTime() - start) / 1e9);
                 }
-                else
-                    System.out.println("\nResquest is to fly from " + userDepartureCity + " to " + userDestination + ".\n"
-                                             + "Sorry.  USAir does not fly from " + userDepartureCity + " to " + userDestination + ".");
-                cityBuf.close();
-                flightBuf.close();
+                else if(faresFile != null)
+                    fares = FlightSimFares.load(faresFile, graph);
+                if(batchFile != null)
+                    FlightSimBatch.run(graph, fares, batchFile, threads);
             }
-            catch (IOException ex)
+            catch (IOException | IllegalArgumentException | InterruptedException | ExecutionException ex)
             {
-                System.out.println("Error: Invalid file(s).");
-                break;
+                System.out.println("Error: " + ex.getMessage());
             }
+            return;
         }
-    }
-
-    //---------------------------------------------------------End of Main Method--------------------------------------------------------
 
-    public static City getCity(ArrayList<City> cities, int l, int r, String cityName)
-    {
-        if(r >= l)
+        for(int city = 0; city < graph.getNumCities(); city++)
         {
-            int mid = l + (r - l)/2;
-            if((cities.get(mid).getCityName()).compareTo(cityName) == 0)
-                return cities.get(mid);
-            if((cities.get(mid).getCityName()).compareTo(cityName) > 0)
-                return getCity(cities, l, mid - 1, cityName);
-            return getCity(cities, mid + 1, r, cityName);
+            System.out.println(graph.getCityName(city));
+            for(int f = graph.getFirstFlight(city); f < graph.getFirstFlight(city + 1); f++)
+            {
+                System.out.println(graph.getCityName(city) + "'s flight destination: " + graph.getCityName(graph.getDestination(f)));
+                System.out.println("Ticket price: " + graph.getTicketPrice(f));
+            }
         }
-        return null;
-    }
 
-    public static int getTicketPrice(ArrayList<Flight> flights, City dest)
-    {
-        for(int i = 0; i < flights.size(); i++)
+        FlightSimGraph.Search search = new FlightSimGraph.Search(graph);
+        System.out.println("Welcome to USAir!");
+        while(true)
         {
-            if(flights.get(i).getDestination() == dest)
-                return flights.get(i).getTicketPrice();
-        }
-        return -1;
-    }
+            //-----------------------------------------------Read In User Flight Info-----------------------------------------------
 
-    public static int getCityIndex(ArrayList<City> cities, int l, int r, String cityName)
-    {
-        if(r >= l)
-        {
-            int mid = l + (r - l)/2;
-            if((cities.get(mid).getCityName()).compareTo(cityName) == 0)
-                return mid;
-            if((cities.get(mid).getCityName()).compareTo(cityName) > 0)
-                return getCityIndex(cities, l, mid - 1, cityName);
-            return getCityIndex(cities, mid + 1, r, cityName);
+            System.out.println("\nWould you like to make flight reservations? (Y/N)");
+            String userResponse = keyboard.hasNextLine() ? keyboard.nextLine().trim() : "N";
+            if(!(userResponse.equalsIgnoreCase("Y") || userResponse.equalsIgnoreCase("Yes")))
+            {
+                System.out.println("Goodbye!");
+                break;
+            }
+
+            // Read in user's flight details (departure city & destination)
+            System.out.println("Please enter the city you wish to depart from: ");
+            String userDepartureCity = keyboard.hasNextLine() ? keyboard.nextLine().trim() : "";
+            System.out.println("Please enter the city you wish to travel to: ");
+            String userDestination = keyboard.hasNextLine() ? keyboard.nextLine().trim() : "";
+
+            //---------------------------------------------Verify User Flight Info---------------------------------------------
+
+            int departure = graph.getCityId(userDepartureCity);
+            int destination = graph.getCityId(userDestination);
+
+            // If the userDepartureCity or userDestination are invalid, restart
+            if(departure == -1)
+            {
+                System.out.println("Error: Invalid departure city.  Please try again.");
+                continue;
+            }
+            if(destination == -1)
+            {
+                System.out.println("\nResquest is to fly from " + userDepartureCity + " to " + userDestination + ".\n"
+                                         + "Sorry.  USAir does not serve " + userDestination + ".");
+                continue;
+            }
+
+            //-------------------------------------------Cheapest Flight Path & Reconstruction-------------------------------------------
+
+            int totalCost = search.cheapest(departure, destination);
+            if(totalCost != FlightSimGraph.NO_ROUTE)
+            {
+                int[] flightPath = search.getPath(destination);
+                System.out.println("\nResquest is to fly from " + userDepartureCity + " to " + userDestination + ".");
+                for(int i = 1; i < flightPath.length; i++)
+                {
+                    System.out.println("Flight from " + graph.getCityName(flightPath[i - 1]) + " to " + graph.getCityName(flightPath[i])
+                                     + "\tCost: $" + search.getPriceInto(flightPath[i]));
+                }
+                System.out.println("Total Cost................... $" + totalCost);
+            }
+            else
+                System.out.println("\nResquest is to fly from " + userDepartureCity + " to " + userDestination + ".\n"
+                                         + "Sorry.  USAir does not fly from " + userDepartureCity + " to " + userDestination + ".");
         }
-        return -1;
     }
 }
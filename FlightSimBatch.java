@@ -0,0 +1,181 @@
+/* Author: Zach Fukuhara <zfukuhara@sandiego.edu>
+ *
+ * Description:  Batch pricing for FlightBookingSimulator.java.  A file of
+ * "from, to" pairs is priced in one go, split across threads, and each thread
+ * has its own FlightSimGraph.Search over the one shared graph.  If a
+ * FlightSimFares table is loaded, each pair is a lookup in it instead of a
+ * search.  The benchmark does the same on a random network, to see how many
+ * queries per second each approach manages.
+ */
+
+import java.io.*;
+import java.util.*;
+import java.util.concurrent.*;
+public class FlightSimBatch
+{
+    /*
+     * Prices trips from[i] -> to[i] on threads threads.
+     *
+     * @param fares precomputed fares to look up instead of searching, or null
+     * @return the cheapest fare of each trip, or FlightSimGraph.NO_ROUTE
+     */
+    public static int[] price(final FlightSimGraph graph, final FlightSimFares fares, final int[] from, final int[] to, int threads)
+            throws InterruptedException, ExecutionException
+    {
+        final int[] cost = new int[from.length];
+        final int chunk = (from.length + threads - 1) / threads;
+
+        ExecutorService pool = Executors.newFixedThreadPool(threads);
+        try
+        {
+            ArrayList<Future<?>> workers = new ArrayList<Future<?>>();
+            for(int start = 0; start < from.length; start += chunk)
+            {
+                final int first = start, last = Math.min(from.length, start + chunk);
+                workers.add(pool.submit(() -> {
+                    if(fares != null)
+                    {
+                        for(int i = first; i < last; i++)
+                            cost[i] = fares.getFare(from[i], to[i]);
+                        return;
+                    }
+                    FlightSimGraph.Search search = new FlightSimGraph.Search(graph);
+                    for(int i = first; i < last; i++)
+                        cost[i] = search.cheapest(from[i], to[i]);
+                }));
+            }
+            for(Future<?> worker : workers)
+                worker.get();
+        }
+        finally
+        {
+            pool.shutdownNow();
+        }
+        return cost;
+    }
+
+    /*
+     * Prices every "from, to" line of pairsFile and prints "from, to, fare"
+     * for each, in the same order, with "none" as the fare if there is no way
+     * to fly it and "unknown" if a city isn't served.  The time taken goes to
+     * standard error.
+     */
+    public static void run(FlightSimGraph graph, FlightSimFares fares, String pairsFile, int threads)
+            throws IOException, InterruptedException, ExecutionException
+    {
+        ArrayList<String> fromNames = new ArrayList<String>(), toNames = new ArrayList<String>();
+        BufferedReader pairBuf = new BufferedReader(new FileReader(pairsFile));
+        String line;
+        while((line = pairBuf.readLine()) != null)
+        {
+            if(line.trim().isEmpty())
+                continue;
+            StringTokenizer temp = new StringTokenizer(line, ",");
+            if(temp.countTokens() < 2)
+                throw new IOException("bad trip: " + line);
+            fromNames.add(temp.nextToken().trim());
+            toNames.add(temp.nextToken().trim());
+        }
+        pairBuf.close();
+
+        // Only trips between served cities are priced; slot[i] is trip i's
+        // place in the priced arrays, or -1 if a city is unknown.  There may
+        // be no cities at all, so an unknown city can't stand in as city 0.
+        int numTrips = fromNames.size(), priced = 0;
+        int[] from = new int[numTrips], to = new int[numTrips], slot = new int[numTrips];
+        for(int i = 0; i < numTrips; i++)
+        {
+            int fromId = graph.getCityId(fromNames.get(i)), toId = graph.getCityId(toNames.get(i));
+            slot[i] = -1;
+            if(fromId != -1 && toId != -1)
+            {
+                from[priced] = fromId;
+                to[priced] = toId;
+                slot[i] = priced++;
+            }
+        }
+        from = Arrays.copyOf(from, priced);
+        to = Arrays.copyOf(to, priced);
+
+        long start = System.nanoTime();
+        int[] cost = price(graph, fares, from, to, threads);
+        double seconds = (System.nanoTime() - start) / 1e9;
+
+        PrintWriter output = new PrintWriter(new BufferedWriter(new OutputStreamWriter(System.out), 1 << 16));
+        for(int i = 0; i < numTrips; i++)
+        {
+            output.println(fromNames.get(i) + ", " + toNames.get(i) + ", " + (slot[i] == -1 ? "unknown"
+                         : cost[slot[i]] == FlightSimGraph.NO_ROUTE ? "none" : String.valueOf(cost[slot[i]])));
+        }
+        output.flush();
+        System.err.printf("%d trips priced in %.3f s (%.0f per second, %s, %d threads)%n", priced, seconds,
+                priced / seconds, fares != null ? "fare table" : "searching", threads);
+    }
+
+    /*
+     * Builds a random network of numCities cities with flightsPerCity flights
+     * out of each (to random cities, for $50-$999) and times pricing queries
+     * random trips on it: one search at a time, searches on threads threads,
+     * building the fare table and looking trips up in it.
+     */
+    public static void benchmark(int numCities, int flightsPerCity, int queries, int threads)
+            throws InterruptedException, ExecutionException
+    {
+        if(numCities < 1 || flightsPerCity < 0 || queries < 1)
+            throw new IllegalArgumentException("need at least one city and one query");
+        Random random = new Random(285);
+        String[] names = new String[numCities];
+        HashMap<String, Integer> ids = new HashMap<String, Integer>();
+        for(int c = 0; c < numCities; c++)
+        {
+            names[c] = "City" + c;
+            ids.put(names[c], c);
+        }
+        int count = numCities * flightsPerCity;
+        int[] flightFrom = new int[count], flightTo = new int[count], price = new int[count];
+        for(int i = 0; i < count; i++)
+        {
+            flightFrom[i] = i / flightsPerCity;
+            flightTo[i] = random.nextInt(numCities);
+            price[i] = 50 + random.nextInt(950);
+        }
+
+        long start = System.nanoTime();
+        FlightSimGraph graph = FlightSimGraph.build(names, ids, flightFrom, flightTo, price, count);
+        System.out.printf("Graph: %d cities, %d flights, built in %.3f s%n", numCities, count, (System.nanoTime() - start) / 1e9);
+
+        int[] from = new int[queries], to = new int[queries];
+        for(int i = 0; i < queries; i++)
+        {
+            from[i] = random.nextInt(numCities);
+            to[i] = random.nextInt(numCities);
+        }
+
+        start = System.nanoTime();
+        int[] single = price(graph, null, from, to, 1);
+        double seconds = (System.nanoTime() - start) / 1e9;
+        System.out.printf("Search, 1 thread:   %10.0f queries/s (%.1f us each)%n", queries / seconds, seconds * 1e6 / queries);
+
+        start = System.nanoTime();
+        int[] parallel = price(graph, null, from, to, threads);
+        seconds = (System.nanoTime() - start) / 1e9;
+        System.out.printf("Search, %d threads: %10.0f queries/s%n", threads, queries / seconds);
+
+        if(numCities > FlightSimFares.MAXCITIES)
+        {
+            System.out.println("Fare table: skipped, more than " + FlightSimFares.MAXCITIES + " cities");
+            return;
+        }
+        start = System.nanoTime();
+        FlightSimFares fares = FlightSimFares.precompute(graph, threads);
+        System.out.printf("Fare table: built in %.3f s on %d threads%n", (System.nanoTime() - start) / 1e9, threads);
+
+        start = System.nanoTime();
+        int[] looked = price(graph, fares, from, to, 1);
+        seconds = (System.nanoTime() - start) / 1e9;
+        System.out.printf("Fare table lookup:  %10.0f queries/s (%.3f us each)%n", queries / seconds, seconds * 1e6 / queries);
+
+        if(!Arrays.equals(single, parallel) || !Arrays.equals(single, looked))
+            System.out.println("Error: the three ways of pricing disagree");
+    }
+}
@@ -0,0 +1,126 @@
+/* Author: Zach Fukuhara <zfukuhara@sandiego.edu>
+ *
+ * Description:  Precomputed table of the cheapest fare between every pair of
+ * cities in a FlightSimGraph, for pricing lots of trips on a small network.
+ * It is built once by searching from every city (a city per thread) and
+ * saved to disk, after which a fare is a single array lookup.  The table is
+ * (number of cities)^2 ints, so it is only built for networks of up to
+ * MAXCITIES cities.  Bigger networks are priced by searching (see
+ * FlightSimBatch).
+ *
+ * The file is "FARE", the number of cities, the graph's fingerprint and then
+ * the table row by row, all big-endian.  A table is only loaded against the
+ * graph it was built from.
+ */
+
+import java.io.*;
+import java.nio.ByteBuffer;
+import java.util.concurrent.*;
+import java.util.concurrent.atomic.AtomicInteger;
+public class FlightSimFares
+{
+    public static final int MAXCITIES = 8192;   // 256 MB of fares
+    private static final int MAGIC = 'F' << 24 | 'A' << 16 | 'R' << 8 | 'E';
+
+    private final int numCities;
+    private final long fingerprint;
+    private final int[] fares;      // fares[from * numCities + to], or NO_ROUTE
+
+    private FlightSimFares(int numCities, long fingerprint, int[] fares)
+    {
+        this.numCities = numCities;
+        this.fingerprint = fingerprint;
+        this.fares = fares;
+    }
+
+    // Returns the cheapest fare from -> to, or FlightSimGraph.NO_ROUTE
+    public int getFare(int from, int to)
+    {
+        return fares[from * numCities + to];
+    }
+
+    /*
+     * Searches from every city of graph on threads threads and returns the
+     * table of their costs.
+     */
+    public static FlightSimFares precompute(final FlightSimGraph graph, int threads)
+            throws InterruptedException, ExecutionException
+    {
+        final int n = graph.getNumCities();
+        if(n > MAXCITIES)
+            throw new IllegalArgumentException("too many cities (" + n + ") for a fare table, the most is " + MAXCITIES);
+        final int[] fares = new int[n * n];
+        final AtomicInteger nextCity = new AtomicInteger();
+
+        ExecutorService pool = Executors.newFixedThreadPool(threads);
+        try
+        {
+            Future<?>[] workers = new Future<?>[threads];
+            for(int t = 0; t < threads; t++)
+            {
+                workers[t] = pool.submit(() -> {
+                    FlightSimGraph.Search search = new FlightSimGraph.Search(graph);
+                    for(int from = nextCity.getAndIncrement(); from < n; from = nextCity.getAndIncrement())
+                    {
+                        search.cheapest(from, -1);
+                        for(int to = 0; to < n; to++)
+                            fares[from * n + to] = search.getCost(to);
+                    }
+                });
+            }
+            for(Future<?> worker : workers)
+                worker.get();
+        }
+        finally
+        {
+            pool.shutdownNow();
+        }
+        return new FlightSimFares(n, graph.getFingerprint(), fares);
+    }
+
+    public void save(String filename) throws IOException
+    {
+        DataOutputStream output = new DataOutputStream(new BufferedOutputStream(new FileOutputStream(filename)));
+        output.writeInt(MAGIC);
+        output.writeInt(numCities);
+        output.writeLong(fingerprint);
+
+        byte[] chunk = new byte[1 << 20];
+        for(int i = 0; i < fares.length; i += chunk.length / 4)
+        {
+            int count = Math.min(chunk.length / 4, fares.length - i);
+            ByteBuffer.wrap(chunk).asIntBuffer().put(fares, i, count);
+            output.write(chunk, 0, 4 * count);
+        }
+        output.close();
+    }
+
+    // Loads a table saved by save, which must have been built from graph
+    public static FlightSimFares load(String filename, FlightSimGraph graph) throws IOException
+    {
+        DataInputStream input = new DataInputStream(new BufferedInputStream(new FileInputStream(filename)));
+        try
+        {
+            if(input.readInt() != MAGIC)
+                throw new IOException(filename + " is not a fare table");
+            int n = input.readInt();
+            long fingerprint = input.readLong();
+            if(n != graph.getNumCities() || fingerprint != graph.getFingerprint())
+                throw new IOException(filename + " was built from different city or flight files");
+
+            int[] fares = new int[n * n];
+            byte[] chunk = new byte[1 << 20];
+            for(int i = 0; i < fares.length; i += chunk.length / 4)
+            {
+                int count = Math.min(chunk.length / 4, fares.length - i);
+                input.readFully(chunk, 0, 4 * count);
+                ByteBuffer.wrap(chunk).asIntBuffer().get(fares, i, count);
+            }
+            return new FlightSimFares(n, fingerprint, fares);
+        }
+        finally
+        {
+            input.close();
+        }
+    }
+}
@@ -0,0 +1,316 @@
+/* Author: Zach Fukuhara <zfukuhara@sandiego.edu>
+ *
+ * Description:  Flight map for FlightBookingSimulator.java.  It is loaded once
+ * from the city and flight files and kept in compact arrays, so one load can
+ * answer any number of cheapest flight path queries.  Cities are numbered in
+ * the order they appear in the city file and looked up by name in a hash map.
+ * The flights leaving city c are flights firstFlight[c] to firstFlight[c + 1] - 1
+ * of flightTo and flightPrice (compressed sparse row form), so there is no
+ * object per city or flight.
+ *
+ * Nothing in the graph changes during a search.  Each search keeps its costs
+ * and parents in a Search, so several can run over the same graph at once.
+ */
+
+import java.io.*;
+import java.util.*;
+public class FlightSimGraph
+{
+    public static final int NO_ROUTE = Integer.MAX_VALUE;
+
+    private final String[] cityNames;
+    private final HashMap<String, Integer> cityIds;
+    private final int[] firstFlight;    // length is the number of cities + 1
+    private final int[] flightTo;
+    private final int[] flightPrice;
+
+    private FlightSimGraph(String[] names, HashMap<String, Integer> ids, int[] first, int[] to, int[] price)
+    {
+        cityNames = names;
+        cityIds = ids;
+        firstFlight = first;
+        flightTo = to;
+        flightPrice = price;
+    }
+
+    /*
+     * Reads the cities (one per line) and the flights ("from, to, price" per
+     * line).  Flights to or from cities that aren't in the city file are skipped.
+     */
+    public static FlightSimGraph load(String cityFile, String flightFile) throws IOException
+    {
+        ArrayList<String> names = new ArrayList<String>();
+        HashMap<String, Integer> ids = new HashMap<String, Integer>();
+        String line;
+
+        // Read in the cities
+        BufferedReader cityBuf = new BufferedReader(new FileReader(cityFile));
+        while((line = cityBuf.readLine()) != null)
+        {
+            line = line.trim();
+            if(!line.isEmpty() && !ids.containsKey(line))
+            {
+                ids.put(line, names.size());
+                names.add(line);
+            }
+        }
+        cityBuf.close();
+
+        // Read in the flights as (from, to, price) triples
+        int count = 0;
+        int[] from = new int[1024], to = new int[1024], price = new int[1024];
+        BufferedReader flightBuf = new BufferedReader(new FileReader(flightFile));
+        while((line = flightBuf.readLine()) != null)
+        {
+            if(line.trim().isEmpty())
+                continue;
+            StringTokenizer temp = new StringTokenizer(line, ",");
+            if(temp.countTokens() < 3)
+                throw new IOException("bad flight: " + line);
+            Integer departure = ids.get(temp.nextToken().trim());
+            Integer destination = ids.get(temp.nextToken().trim());
+            int ticketPrice;
+            try
+            {
+                ticketPrice = Integer.parseInt(temp.nextToken().trim());
+            }
+            catch (NumberFormatException ex)
+            {
+                throw new IOException("bad ticket price: " + line);
+            }
+            if(ticketPrice < 0)
+                throw new IOException("negative ticket price: " + line);
+            if(departure == null || destination == null)
+                continue;
+
+            if(count == from.length)
+            {
+                from = Arrays.copyOf(from, 2 * count);
+                to = Arrays.copyOf(to, 2 * count);
+                price = Arrays.copyOf(price, 2 * count);
+            }
+            from[count] = departure;
+            to[count] = destination;
+            price[count] = ticketPrice;
+            count++;
+        }
+        flightBuf.close();
+
+        return build(names.toArray(new String[0]), ids, from, to, price, count);
+    }
+
+    /*
+     * Builds the graph from count flights, flight i going from city from[i] to
+     * city to[i] for price[i], by grouping them by departure city.
+     */
+    static FlightSimGraph build(String[] names, HashMap<String, Integer> ids, int[] from, int[] to, int[] price, int count)
+    {
+        int numCities = names.length;
+        int[] first = new int[numCities + 1];
+        for(int i = 0; i < count; i++)
+            first[from[i] + 1]++;
+        for(int c = 0; c < numCities; c++)
+            first[c + 1] += first[c];
+
+        int[] next = Arrays.copyOf(first, numCities);
+        int[] flightTo = new int[count], flightPrice = new int[count];
+        for(int i = 0; i < count; i++)
+        {
+            int slot = next[from[i]]++;
+            flightTo[slot] = to[i];
+            flightPrice[slot] = price[i];
+        }
+        return new FlightSimGraph(names, ids, first, flightTo, flightPrice);
+    }
+
+    //-----------------------Getters-------------------------
+
+    public int getNumCities()
+    {
+        return cityNames.length;
+    }
+
+    public int getNumFlights()
+    {
+        return flightTo.length;
+    }
+
+    // Returns the number of the city, or -1 if there is no such city
+    public int getCityId(String cityName)
+    {
+        Integer id = cityIds.get(cityName);
+        return id == null ? -1 : id;
+    }
+
+    public String getCityName(int city)
+    {
+        return cityNames[city];
+    }
+
+    // The flights from city are getFirstFlight(city) to getFirstFlight(city + 1) - 1
+    public int getFirstFlight(int city)
+    {
+        return firstFlight[city];
+    }
+
+    public int getDestination(int flight)
+    {
+        return flightTo[flight];
+    }
+
+    public int getTicketPrice(int flight)
+    {
+        return flightPrice[flight];
+    }
+
+    // Hash of the cities and flights, so a table computed from this graph can
+    // tell whether it still matches
+    public long getFingerprint()
+    {
+        long hash = cityNames.length;
+        for(int c = 0; c < cityNames.length; c++)
+            hash = hash * 31 + cityNames[c].hashCode();
+        for(int f = 0; f < flightTo.length; f++)
+            hash = (hash * 31 + flightTo[f]) * 31 + flightPrice[f];
+        for(int c = 0; c <= cityNames.length; c++)
+            hash = hash * 31 + firstFlight[c];
+        return hash;
+    }
+
+    /*
+     * Dijkstra's algorithm over a FlightSimGraph with a binary heap.  The cost,
+     * parent city and flight taken for each city live in arrays here instead
+     * of in the graph.  A city's entries only count if its stamp is the current
+     * search's, so nothing has to be cleared between searches and a Search can
+     * be reused for query after query.  Use one per thread.
+     */
+    public static class Search
+    {
+        private final FlightSimGraph graph;
+        private final int[] cost;
+        private final int[] parent;
+        private final int[] via;        // flight taken into each city
+        private final int[] stamp;
+        private int current = 0;
+
+        // Cities waiting to be visited, keyed by (cost << 32 | city).  A city is
+        // pushed again whenever a cheaper way to it is found, and the old entry
+        // is skipped when it comes out.
+        private long[] heap = new long[64];
+        private int heapSize = 0;
+
+        public Search(FlightSimGraph graph)
+        {
+            this.graph = graph;
+            int numCities = graph.getNumCities();
+            cost = new int[numCities];
+            parent = new int[numCities];
+            via = new int[numCities];
+            stamp = new int[numCities];
+        }
+
+        // Returns the cost of the cheapest flight path from -> to, or NO_ROUTE.
+        // With to -1 the search runs until every city it can reach is settled,
+        // and getCost gives the cost to each of them.
+        public int cheapest(int from, int to)
+        {
+            if(++current == Integer.MAX_VALUE)
+            {
+                Arrays.fill(stamp, 0);
+                current = 1;
+            }
+            heapSize = 0;
+            stamp[from] = current;
+            cost[from] = 0;
+            parent[from] = -1;
+            push(from, 0);
+
+            while(heapSize > 0)
+            {
+                long top = pop();
+                int city = (int)top;
+                int cityCost = (int)(top >>> 32);
+                if(cityCost > cost[city])
+                    continue;
+                if(city == to)
+                    return cityCost;
+
+                for(int f = graph.firstFlight[city]; f < graph.firstFlight[city + 1]; f++)
+                {
+                    int next = graph.flightTo[f];
+                    long nextCost = (long)cityCost + graph.flightPrice[f];
+                    if(nextCost < NO_ROUTE && (stamp[next] != current || nextCost < cost[next]))
+                    {
+                        stamp[next] = current;
+                        cost[next] = (int)nextCost;
+                        parent[next] = city;
+                        via[next] = f;
+                        push(next, (int)nextCost);
+                    }
+                }
+            }
+            return NO_ROUTE;
+        }
+
+        // Returns the cost the last search found to city, or NO_ROUTE if it didn't reach it
+        public int getCost(int city)
+        {
+            return stamp[city] == current ? cost[city] : NO_ROUTE;
+        }
+
+        /*
+         * Returns the cities on the path the last search found to city, starting
+         * with the city it left from.  city must be the destination of that search
+         * (or a city on its path) and reachable.
+         */
+        public int[] getPath(int city)
+        {
+            int length = 1;
+            for(int c = city; parent[c] != -1; c = parent[c])
+                length++;
+            int[] path = new int[length];
+            for(int c = city, i = length - 1; i >= 0; c = parent[c], i--)
+                path[i] = c;
+            return path;
+        }
+
+        // Returns the price of the flight the last search took into city
+        public int getPriceInto(int city)
+        {
+            return graph.flightPrice[via[city]];
+        }
+
+        private void push(int city, int cityCost)
+        {
+            if(heapSize == heap.length)
+                heap = Arrays.copyOf(heap, 2 * heapSize);
+            long key = (long)cityCost << 32 | city;
+            int i = heapSize++;
+            while(i > 0 && heap[(i - 1) / 2] > key)
+            {
+                heap[i] = heap[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            heap[i] = key;
+        }
+
+        private long pop()
+        {
+            long top = heap[0];
+            long last = heap[--heapSize];
+            int i = 0;
+            while(2 * i + 1 < heapSize)
+            {
+                int child = 2 * i + 1;
+                if(child + 1 < heapSize && heap[child + 1] < heap[child])
+                    child++;
+                if(heap[child] >= last)
+                    break;
+                heap[i] = heap[child];
+                i = child;
+            }
+            heap[i] = last;
+            return top;
+        }
+    }
+}
@@ -0,0 +1,253 @@
+/* Author: Zach Fukuhara
+ *
+ * Description:
+ * RoundTrip.java checks Compress and Decompress against each other.  Every
+ * input is compressed and decompressed at 9, 12, 16 and 20 bit codes and in
+ * the framed format, and what comes back is compared byte for byte with the
+ * original.  A range from the middle of each framed file is also extracted
+ * and checked.  The size, compression ratio and speed in MB/s of every round
+ * trip are printed, then the totals for each mode and for all the stream
+ * and all the framed runs, and the exit status is 1 if any round trip
+ * failed.
+ *
+ * Usage: java RoundTrip [file or directory ...]
+ * With no arguments the files in zzz-corpus are used.  A name.zzz with a
+ * name.expected beside it is a v1 file, and is decoded and compared with
+ * name.expected instead.  records-v1.zzz is synthetic: it was written by a
+ * Python transcription of the original Compress from records.txt, not by
+ * the original Java, and records-v1.expected is records.txt without the
+ * prefix that encoder drops at the end.  Replace both with files from the
+ * original classes when a JDK is at hand.
+ *
+ * Generated inputs are added for what small files can't reach: megabytes of
+ * text, a long run of one byte, random bytes, and text that turns into
+ * random bytes and back, which fills the dictionary and makes Compress send
+ * CLEAR.
+*/
+
+import java.io.*;
+import java.nio.file.Files;
+import java.util.*;
+import java.util.concurrent.ExecutionException;
+public class RoundTrip {
+    static final String CORPUS = "zzz-corpus";
+    static final int[] BITS = {9, 12, 16, 20};
+    // Framed runs as {code width, block size}.  The odd block size puts block
+    // boundaries in the middle of everything.
+    static final int[][] FRAMED = {{16, 1 << 16}, {9, 4093}};
+
+    // Totals per mode, and for all stream and all framed modes: bytes in,
+    // bytes coded, nanoseconds compressing and nanoseconds decompressing
+    static LinkedHashMap<String, long[]> totals = new LinkedHashMap<>();
+    static long[] allStream = new long[4], allFramed = new long[4];
+    static int runs = 0, failures = 0;
+
+    public static void main(String[] args) {
+        try {
+            warmUp();
+            System.out.printf("%-24s %10s  %-14s %10s %7s %10s %10s%n", "input", "bytes", "mode", "coded",
+                    "ratio", "comp MB/s", "dec MB/s");
+
+            for (String arg : args.length == 0 ? new String[] {CORPUS} : args) {
+                File given = new File(arg);
+                File[] files = given.isDirectory() ? given.listFiles() : new File[] {given};
+                if (files == null || !given.exists()) {
+                    System.err.println("Cannot read " + arg);
+                    System.exit(1);
+                }
+                Arrays.sort(files);
+                for (File file : files) {
+                    String name = file.getName();
+                    File expected = new File(file.getParentFile(), name.replaceAll("\\.zzz$", "") + ".expected");
+                    if (!file.isFile() || name.endsWith(".expected"))
+                        continue;
+                    if (name.endsWith(".zzz") && expected.isFile())
+                        checkV1(name, Files.readAllBytes(file.toPath()), Files.readAllBytes(expected.toPath()));
+                    else
+                        check(name, Files.readAllBytes(file.toPath()));
+                }
+            }
+
+            byte[] noise = new byte[1 << 20];
+            new Random(285).nextBytes(noise);
+            byte[] run = new byte[2 << 20];
+            Arrays.fill(run, (byte)'a');
+            check("(text)", words(8 << 20, 1));
+            check("(run)", run);
+            check("(random)", noise);
+            check("(text, random, text)", join(words(1 << 20, 2), noise, words(1 << 20, 3)));
+        }
+        catch (IOException | InterruptedException e) {
+            System.err.println("Cannot run the round trips: " + e);
+            System.exit(1);
+        }
+
+        System.out.printf("%nTotals%n");
+        for (Map.Entry<String, long[]> mode : totals.entrySet())
+            printTotal(mode.getKey(), mode.getValue());
+        printTotal("all stream", allStream);
+        printTotal("all framed", allFramed);
+        System.out.printf("%d of %d round trips OK%n", runs - failures, runs);
+        System.exit(failures == 0 ? 0 : 1);
+    }
+
+    // Round trips data in every mode
+    static void check(String name, byte[] data) throws InterruptedException {
+        for (int bits : BITS) {
+            String mode = "-b " + bits;
+            try {
+                long began = System.nanoTime();
+                ByteArrayOutputStream coded = new ByteArrayOutputStream(data.length / 2 + 16);
+                Compress.compress(new ByteArrayInputStream(data), coded, bits);
+                long middle = System.nanoTime();
+                ByteArrayOutputStream decoded = new ByteArrayOutputStream(data.length + 16);
+                Decompress.decompress(new ByteArrayInputStream(coded.toByteArray()), decoded, null);
+                long end = System.nanoTime();
+                report(name, mode, data.length, coded.size(), middle - began, end - middle,
+                        Arrays.equals(data, decoded.toByteArray()));
+            }
+            catch (IOException | ExecutionException e) {
+                fail(name, mode, e);
+            }
+        }
+
+        // Framed files are decoded from a file, since the block index is read
+        // from the end of it
+        for (int[] framed : FRAMED) {
+            String mode = "-B " + framed[1] + " -b " + framed[0];
+            File temp = null;
+            try {
+                temp = File.createTempFile("roundtrip", ".zzz");
+                long began = System.nanoTime();
+                OutputStream out = new FileOutputStream(temp);
+                Compress.compressBlocks(new ByteArrayInputStream(data), out, framed[0], framed[1]);
+                out.close();
+                long middle = System.nanoTime();
+                ByteArrayOutputStream decoded = new ByteArrayOutputStream(data.length + 16);
+                InputStream in = new FileInputStream(temp);
+                Decompress.decompress(in, decoded, temp.getPath());
+                in.close();
+                long end = System.nanoTime();
+                boolean ok = Arrays.equals(data, decoded.toByteArray());
+
+                int start = data.length / 3, length = data.length / 3 + 1;
+                ByteArrayOutputStream range = new ByteArrayOutputStream(length);
+                Decompress.decodeBlocks(temp.getPath(), range, start, length);
+                ok = ok && Arrays.equals(Arrays.copyOfRange(data, start, Math.min(data.length, start + length)),
+                        range.toByteArray());
+                report(name, mode, data.length, temp.length(), middle - began, end - middle, ok);
+            }
+            catch (IOException | ExecutionException e) {
+                fail(name, mode, e);
+            }
+            finally {
+                if (temp != null)
+                    temp.delete();
+            }
+        }
+    }
+
+    // Decodes a v1 file and compares it with the text it should give
+    static void checkV1(String name, byte[] coded, byte[] expected) throws InterruptedException {
+        try {
+            long began = System.nanoTime();
+            ByteArrayOutputStream decoded = new ByteArrayOutputStream(expected.length + 16);
+            Decompress.decompress(new ByteArrayInputStream(coded), decoded, null);
+            long end = System.nanoTime();
+            report(name, "v1", expected.length, coded.length, 0, end - began,
+                    Arrays.equals(expected, decoded.toByteArray()));
+        }
+        catch (IOException | ExecutionException e) {
+            fail(name, "v1", e);
+        }
+    }
+
+    static void report(String name, String mode, long size, long coded, long compressNanos, long decompressNanos,
+            boolean ok) {
+        System.out.printf("%-24s %10d  %-14s %10d %6.1f%% %10s %10s%s%n", name, size, mode, coded,
+                size == 0 ? 0.0 : 100.0 * coded / size, speed(size, compressNanos), speed(size, decompressNanos),
+                ok ? "" : "  FAILED: output differs");
+        long[] t = totals.get(mode);
+        if (t == null)
+            totals.put(mode, t = new long[4]);
+        long[] all = mode.startsWith("-B") ? allFramed : mode.startsWith("-b") ? allStream : null;
+        for (long[] total : new long[][] {t, all}) {
+            if (total == null)
+                continue;
+            total[0] += size;
+            total[1] += coded;
+            total[2] += compressNanos;
+            total[3] += decompressNanos;
+        }
+        runs++;
+        if (!ok)
+            failures++;
+    }
+
+    static void printTotal(String mode, long[] t) {
+        System.out.printf("%-24s %10d  %-14s %10d %6.1f%% %10s %10s%n", "", t[0], mode, t[1],
+                t[0] == 0 ? 0.0 : 100.0 * t[1] / t[0], speed(t[0], t[2]), speed(t[0], t[3]));
+    }
+
+    static void fail(String name, String mode, Exception e) {
+        System.out.printf("%-24s %-14s FAILED: %s%n", name, mode, e);
+        runs++;
+        failures++;
+    }
+
+    // MB/s for size bytes in nanos nanoseconds, or "-" if it wasn't timed
+    static String speed(long size, long nanos) {
+        return nanos <= 0 ? "-" : String.format("%.1f", size * 1e3 / nanos);
+    }
+
+    // A few passes over some text so the speeds printed aren't mostly the JIT
+    // compiling the coders
+    static void warmUp() throws IOException, InterruptedException {
+        byte[] text = words(1 << 20, 4);
+        try {
+            for (int i = 0; i < 3; i++) {
+                ByteArrayOutputStream coded = new ByteArrayOutputStream();
+                Compress.compress(new ByteArrayInputStream(text), coded, 16);
+                Decompress.decompress(new ByteArrayInputStream(coded.toByteArray()), new ByteArrayOutputStream(), null);
+            }
+        }
+        catch (ExecutionException e) {
+            throw new IOException(e);
+        }
+    }
+
+    // size bytes of lines of made-up words, the common ones much more often
+    // than the rest, like real text
+    static byte[] words(int size, long seed) {
+        Random random = new Random(seed);
+        String[] vocabulary = new String[2000];
+        for (int i = 0; i < vocabulary.length; i++) {
+            StringBuilder word = new StringBuilder();
+            for (int n = 2 + random.nextInt(8); n > 0; n--)
+                word.append((char)('a' + random.nextInt(26)));
+            vocabulary[i] = word.toString();
+        }
+
+        byte[] text = new byte[size];
+        int pos = 0, column = 0;
+        while (pos < size) {
+            double r = random.nextDouble();
+            String word = vocabulary[(int)(r * r * r * vocabulary.length)];
+            for (int i = 0; i < word.length() && pos < size; i++)
+                text[pos++] = (byte)word.charAt(i);
+            column += word.length() + 1;
+            if (pos < size)
+                text[pos++] = (byte)(column > 72 ? '\n' : ' ');
+            if (column > 72)
+                column = 0;
+        }
+        return text;
+    }
+
+    static byte[] join(byte[]... parts) {
+        ByteArrayOutputStream all = new ByteArrayOutputStream();
+        for (byte[] part : parts)
+            all.write(part, 0, part.length);
+        return all.toByteArray();
+    }
+}
@@ -1,29 +1,94 @@
 /* employee_db.c 
  *
  * This file contains code to implement an employee database program in C.
- * The program stores employee info in an array of employee structs, sorted by
- * employee ID value.  Employee info will be read in from an input file when
+ * The program stores employee info in a compact employee table, sorted by
+ * employee ID value.  IDs and salaries live in their own arrays and names are
+ * interned in a shared string arena, so a record costs 16 bytes plus its
+ * share of the unique names.  Employee info will be read in from an input file when
  * the program first starts.  Users have the option to (1) Print the Database,
  * (2) Lookup by ID, (3) Lookup by Last Name, (4) Add an Employee, (5) Quit.
  *
+ * Passing '-b cmdfile' runs the program in batch mode instead: commands are
+ * read one per line from cmdfile ('-' for stdin) and executed without any
+ * menu or prompts.  Batch commands are:
+ * 		id <id>
+ * 		last <last name>
+ * 		add <id> <first> <last> <salary>
+ * 		update <current id> <new id> <first> <last> <salary>
+ * 		dump
+ * 		compact
+ * 		range <min salary> <max salary>
+ * 		top <k>
+ * 		pct <percentile>
+ * 		bands <band width>
+ *
+ * Passing '-d' makes the database durable.  Changes are appended to a
+ * write-ahead log (database_file.wal) and periodically compacted into a
+ * binary snapshot (database_file.snap) that is mmap'd on the next startup
+ * instead of re-parsing the text file.  '-f always|group|none' picks when
+ * the log is fsync'd, '-g N' sets how many changes share one group commit,
+ * and '-C bytes' sets the log size that triggers a background compaction.
+ *
+ * Passing '-S socket' serves the database to many local clients at once
+ * over a Unix-domain socket.  Lookups run in parallel under a reader-writer
+ * lock while adds and updates are serialised.  '-L socket' runs a load
+ * generator against such a server using IDs from database_file, with '-c'
+ * client threads, '-n' total requests and '-w' percent updates, and prints
+ * latency percentiles.
  *
  * This file is part of COMP 280, Lab #1
  *
  * Author: Zach Fukuhara
  */
 
+#define _GNU_SOURCE     // pthread_rwlockattr_setkind_np
 #include <stdio.h>      // the C standard I/O library
 #include <stdlib.h>     // the C standard library
 #include <string.h>     // the C string library
 #include "readfile.h"   // my file reading routines
 #include <strings.h>	// for strcasecmp
+#include <unistd.h>     // for getopt
+#include <time.h>       // for clock_gettime
+#include <stdint.h>     // fixed width types for the on-disk formats
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap
+#include <sys/stat.h>   // fstat
+#include <stdatomic.h>  // compaction thread's done flag
+#include <sys/socket.h> // Unix-domain socket server
+#include <sys/un.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/select.h> // pselect for the accept loop
  
 // Constants 
 #define MAXFILENAME  128
 #define MAXNAME       64
 #define MAXEMPLOYEE 1024
+#define MAXCMDLINE   512
+#define MINID     100000    // IDs are six digit numbers
+#define MAXID     999999
+#define BATCHBUF  (1 << 16)
+#define MAXPATH      (MAXFILENAME + 16)
+#define SNAPMAGIC    "EMPSNAP"
+#define SNAPVERSION  2
+#define NOFFSET      UINT32_MAX
+#define WAL_ADD      1
+#define WAL_UPDATE   2
+#define FSYNC_ALWAYS 0
+#define FSYNC_GROUP  1
+#define FSYNC_NONE   2
+#define REQ_ID       1
+#define REQ_LAST     2
+#define REQ_ADD      3
+#define REQ_UPDATE   4
+#define RES_OK       0
+#define RES_NOTFOUND 1
+#define RES_INVALID  2
+#define RES_EXISTS   3
+#define FLUSH_USEC   10000
 
-// Employee struct
+// Employee struct.  The table below does not store these; they are only used
+// to pass a whole employee around (log records, adds and updates).
 struct Employee {
 	char first[MAXNAME];
 	char last[MAXNAME];
@@ -39,17 +104,222 @@ typedef struct Employee Employee;
 typedef int bool;
 enum {false, true};
 
+// Interned names: every distinct name is stored once, NUL terminated, in one
+// growing block of bytes and referred to by its 32-bit offset.  An open
+// addressing hash table of offsets finds existing names.
+struct NameArena {
+	char *bytes;
+	uint32_t len;
+	uint32_t capacity;
+	uint32_t *slots;     // offsets into bytes, NOFFSET if empty
+	uint32_t numSlots;   // always a power of two
+	uint32_t count;      // number of distinct names
+};
+typedef struct NameArena NameArena;
+
+// The employee database in compact form.  Row i is ids[i], salaries[i] and
+// the names at firsts[i] and lasts[i] in the arena, so sorting and ID
+// lookups only touch the small fixed-width arrays.
+struct EmployeeTable {
+	int *ids;
+	int *salaries;
+	uint32_t *firsts;    // arena offsets
+	uint32_t *lasts;
+	int capacity;
+	NameArena names;
+};
+typedef struct EmployeeTable EmployeeTable;
+
+// Snapshot file header.  In version 2 the header is followed by the table's
+// ids, salaries, first name offsets and last name offsets ('count' of each)
+// and then the name arena, so the file can be mmap'd and copied in a few
+// memcpys.  Version 1 snapshots hold 'count' Employee structs instead.  The
+// layout is the in-memory layout, so snapshots are not portable between
+// machines of different endianness.
+struct SnapHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint64_t seq;       // last log record included in the snapshot
+	uint32_t checksum;  // over everything after the header
+	uint32_t extra;     // v1: sizeof(Employee), v2: bytes of name arena
+};
+typedef struct SnapHeader SnapHeader;
+
+// One write-ahead log record: a single add or update.  Records are fixed
+// size so a torn write at the end of the log is easy to detect and cut off.
+struct WalRecord {
+	uint32_t checksum;  // over everything after this field
+	uint32_t op;        // WAL_ADD or WAL_UPDATE
+	uint64_t seq;
+	int32_t currId;     // ID being updated (unused for adds)
+	int32_t pad;
+	Employee emp;
+};
+typedef struct WalRecord WalRecord;
+
+// Durable storage state shared by every mode of the program.
+struct Store {
+	bool enabled;
+	int policy;           // FSYNC_ALWAYS, FSYNC_GROUP or FSYNC_NONE
+	int groupSize;        // records per group commit
+	long compactBytes;    // log size that triggers a compaction
+	char snapPath[MAXPATH], tmpPath[MAXPATH];
+	char walPath[MAXPATH], oldWalPath[MAXPATH];
+	int walFd;
+	WalRecord *pending;   // records waiting for the next group commit
+	int numPending;
+	uint64_t seq;         // last sequence number handed out
+	long walBytes;
+	bool compacting;      // a compaction thread is running or unjoined
+	pthread_t compactThread;
+	atomic_int compactDone;   // set by the thread once the snapshot is written
+	int compactResult;    // 0 if the snapshot was written, -1 if not
+	SnapHeader snapHdr;   // snapshot handed to the compaction thread
+	char *snapBody;
+	size_t snapLen;
+	long commits;
+};
+typedef struct Store Store;
+
+static Store store;
+
+// Server request header.  It is followed by firstLen + lastLen bytes of
+// names (no terminators), which only REQ_LAST, REQ_ADD and REQ_UPDATE use.
+struct Request {
+	uint8_t op;         // REQ_ID, REQ_LAST, REQ_ADD or REQ_UPDATE
+	uint8_t firstLen;
+	uint8_t lastLen;
+	uint8_t pad;
+	int32_t id;         // ID to look up, add, or update
+	int32_t newId;      // new ID for REQ_UPDATE
+	int32_t salary;
+};
+typedef struct Request Request;
+
+// Server response header, followed by firstLen + lastLen bytes of names
+// when a lookup finds an employee.
+struct Response {
+	int32_t status;     // RES_OK, RES_NOTFOUND, RES_INVALID or RES_EXISTS
+	int32_t id;
+	int32_t salary;
+	uint8_t firstLen;
+	uint8_t lastLen;
+	uint8_t pad[2];
+};
+typedef struct Response Response;
+
+// The database as shared by the server's connection threads.
+struct Server {
+	EmployeeTable *db;
+	int numEmp;
+	pthread_rwlock_t lock;  // readers: lookups, writer: add/update/log
+};
+typedef struct Server Server;
+
+// Per-thread state for the load generator
+struct ClientArgs {
+	char *sockPath;
+	EmployeeTable *db;  // employees to draw IDs from
+	int numEmp;
+	long numRequests;
+	int writePct;
+	unsigned int seed;
+	double *latencies;  // seconds per request, filled in by the thread
+	long errors;
+};
+typedef struct ClientArgs ClientArgs;
+
+// One entry of the salary index
+struct SalaryKey {
+	int salary;
+	int id;
+};
+typedef struct SalaryKey SalaryKey;
+
+// Ordered secondary index on salary: (salary, id) pairs kept sorted so that
+// range counts, percentiles and top-K are binary searches or direct lookups.
+// Adds and updates keep it in sync once it has been built.
+struct SalaryIndex {
+	SalaryKey *keys;
+	int n;
+	int capacity;
+};
+typedef struct SalaryIndex SalaryIndex;
+
+static SalaryIndex salaryIndex;
+static EmployeeTable *sortTable;  // table being sorted, for the qsort comparators
+static Server server;
+static atomic_int stopServer = 0;  // set by stopHandler, read by every server thread
+
 // Forward Declaration of functions
 void getFilenameFromCommandLine(char filename[], int argc, char *argv[]);
-int readFile(char *filename, Employee *db);
-void printArray(Employee *db, int numEmp);
-void sortById(Employee *db, int numEmp);
-void sortByLast(Employee *db, int numEmp);
-void swap(Employee *emp1, Employee *emp2);
-void lookupById(Employee *db, int id, int numEmp);
-void lookupByLast(Employee *db, char last[], int numEmp);
-void addEmployee(Employee *db, int numEmp, int id, char first[], char last[], int salary);
-void updateEmp(Employee *emp, int id, char first[], char last[], int salary);
+int readFile(char *filename, EmployeeTable *db);
+void printArray(EmployeeTable *db, int numEmp);
+void sortById(EmployeeTable *db, int numEmp);
+void sortByLast(EmployeeTable *db, int numEmp);
+void permute(EmployeeTable *db, int *order, int numEmp);
+int compareIds(const void *a, const void *b);
+int compareNames(const void *a, const void *b);
+void lookupById(EmployeeTable *db, int id, int numEmp);
+void lookupByLast(EmployeeTable *db, char last[], int numEmp);
+void addEmployee(EmployeeTable *db, int numEmp, int id, char first[], char last[], int salary);
+void updateEmp(EmployeeTable *db, int index, int id, char first[], char last[], int salary);
+int findById(EmployeeTable *db, int id, int numEmp);
+int insertById(EmployeeTable *db, int numEmp, Employee *emp);
+int removeAt(EmployeeTable *db, int numEmp, int index);
+void initTable(EmployeeTable *db, int capacity);
+void growTable(EmployeeTable *db, int capacity);
+void freeTable(EmployeeTable *db);
+void setRow(EmployeeTable *db, int index, Employee *emp);
+void getRow(EmployeeTable *db, int index, Employee *emp);
+char *nameAt(EmployeeTable *db, uint32_t offset);
+uint32_t internName(NameArena *names, char *name);
+void addNameSlot(NameArena *names, uint32_t offset);
+bool validEmployee(int id, char first[], char last[], int salary);
+int runBatch(char *cmdfile, EmployeeTable *db, int numEmp);
+double elapsedSeconds(struct timespec *start);
+int addSorted(EmployeeTable *db, int numEmp, Employee *emp);
+int updateAt(EmployeeTable *db, int numEmp, int index, Employee *emp);
+void makeEmployee(Employee *emp, int id, char first[], char last[], int salary);
+void storeInit(char *filename, char *policy, int groupSize, long compactBytes);
+int storeRecover(char *filename, EmployeeTable *db);
+int loadSnapshot(EmployeeTable *db, uint64_t *seq);
+int replayWal(char *path, EmployeeTable *db, int numEmp, uint64_t snapSeq,
+		long *replayed, bool truncateTail);
+void walLog(int op, int currId, Employee *emp);
+void walCommit();
+void startCompaction(EmployeeTable *db, int numEmp);
+void pollCompaction(bool block);
+void storeClose();
+char *packSnapshot(EmployeeTable *db, int numEmp, uint64_t seq, SnapHeader *hdr,
+		size_t *bytes);
+int writeSnapshot(SnapHeader *hdr, char *body, size_t bytes);
+void *compactionFunc(void *arg);
+int writeAll(int fd, void *buf, size_t len);
+uint32_t checksum(void *data, size_t len);
+int readAll(int fd, void *buf, size_t len);
+void runServer(char *sockPath, EmployeeTable *db, int *numEmp);
+void *connectionFunc(void *arg);
+void *flusherFunc(void *arg);
+void handleRequest(Request *req, char *names, Response *res, char *outNames);
+void stopHandler(int sig);
+int connectTo(char *sockPath);
+void runLoadGen(char *sockPath, EmployeeTable *db, int numEmp, long numRequests,
+		int numClients, int writePct);
+void *clientFunc(void *arg);
+int compareDoubles(const void *a, const void *b);
+void buildSalaryIndex(EmployeeTable *db, int numEmp);
+int compareSalaryKeys(const void *a, const void *b);
+int salaryLowerBound(int salary, int id);
+void salaryIndexInsert(int salary, int id);
+void salaryIndexRemove(int salary, int id);
+void printSalaryRange(EmployeeTable *db, int numEmp, int min, int max);
+void printTopSalaries(EmployeeTable *db, int numEmp, int k);
+int salaryPercentile(double pct);
+void printSalaryBands(int width);
+void printRow(EmployeeTable *db, int index);
+void printMemoryUse(EmployeeTable *db, int numEmp);
 
 
 //----------------------------------------Begin Main Method-------------------------------------------
@@ -61,16 +331,91 @@ int main (int argc, char *argv[]) {
 	
 	// Allocate memory on heap for employee database
 	char filename[MAXFILENAME];
-	Employee *db = calloc(MAXEMPLOYEE, sizeof(Employee));
+	EmployeeTable table;
+	EmployeeTable *db = &table;
+	initTable(db, MAXEMPLOYEE);
+
+	// Pull off any options before the database filename
+	char *cmdfile = NULL, *policy = "group", *serverPath = NULL, *loadPath = NULL;
+	bool durable = false;
+	int groupSize = 64, numClients = 4, writePct = 0;
+	long compactBytes = 64L << 20, numRequests = 100000;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:df:g:C:S:L:c:n:w:")) != -1) {
+		if (opt == 'b')
+			cmdfile = optarg;
+		else if (opt == 'd')
+			durable = true;
+		else if (opt == 'f')
+			policy = optarg;
+		else if (opt == 'g')
+			groupSize = atoi(optarg);
+		else if (opt == 'C')
+			compactBytes = atol(optarg);
+		else if (opt == 'S')
+			serverPath = optarg;
+		else if (opt == 'L')
+			loadPath = optarg;
+		else if (opt == 'c')
+			numClients = atoi(optarg);
+		else if (opt == 'n')
+			numRequests = atol(optarg);
+		else if (opt == 'w')
+			writePct = atoi(optarg);
+		else {
+			printf("Usage: %s [-b cmdfile | -S socket | -L socket [-c clients] [-n requests] "
+					"[-w write%%]] [-d [-f always|group|none] [-g N] [-C bytes]] "
+					"database_file\n", argv[0]);
+			exit(1);
+		}
+	}
+	// Every load generator client sends at least one request
+	if (loadPath != NULL && (numClients < 1 || numRequests < numClients)) {
+		printf("Error: need at least one client and at least one request per client\n");
+		exit(1);
+	}
 
 	// This initializes the filename string from the command line arguments
-	getFilenameFromCommandLine(filename, argc, argv);
+	char *fileArgs[2] = {argv[0], argv[optind]};
+	getFilenameFromCommandLine(filename, argc - optind + 1, fileArgs);
 	
-	// Create database of employees
-	int numEmp = readFile(filename, db);
+	// Create database of employees, from the snapshot and log if durable
+	int numEmp;
+	if (durable) {
+		storeInit(filename, policy, groupSize, compactBytes);
+		numEmp = storeRecover(filename, db);
+	}
+	else {
+		numEmp = readFile(filename, db);
+
+		// Sort database by ID values
+		sortById(db, numEmp);
+	}
+	buildSalaryIndex(db, numEmp);
+
+	// Load generator: the database is only used as a source of IDs
+	if (loadPath != NULL) {
+		runLoadGen(loadPath, db, numEmp, numRequests, numClients, writePct);
+		storeClose();
+		freeTable(db);
+		return 0;
+	}
+
+	// Server mode: serve the database until interrupted
+	if (serverPath != NULL) {
+		runServer(serverPath, db, &numEmp);
+		storeClose();
+		freeTable(db);
+		return 0;
+	}
 
-	// Sort database by ID values
-	sortById(db, numEmp);
+	// Batch mode: run the command file and skip the menu entirely
+	if (cmdfile != NULL) {
+		numEmp = runBatch(cmdfile, db, numEmp);
+		storeClose();
+		freeTable(db);
+		return 0;
+	}
 
 	// Prompt user & execute desired task
 	while (true) {
@@ -84,6 +429,7 @@ _____________________________\n\
 (6) Update an employee's information.\n\
 (7) Sort employees by Last Name.\n\
 (8) Sort employees by ID.\n\
+(9) Lookup by Salary Range.\n\
 _____________________________\n\
 Enter your choice: ");
 		
@@ -119,7 +465,7 @@ Enter your choice: ");
 				printf("Enter the employee's salary: ");
 				scanf("%d", salary);
 
-				if (*id < 100000 || *id > 999999) {
+				if (*id < MINID || *id > MAXID) {
 					printf("\n\nInvalid ID.  Enter a six digit number.\n\n");
 					error = 1;
 				}
@@ -137,6 +483,10 @@ Enter your choice: ");
 					if (*yesOrNo == 0) {
 						addEmployee(db, numEmp, *id, first, last, *salary);
 						numEmp++;
+						Employee emp;
+						makeEmployee(&emp, *id, first, last, *salary);
+						walLog(WAL_ADD, 0, &emp);
+						walCommit();
 						break;
 					}
 					else
@@ -161,9 +511,16 @@ Enter your choice: ");
 			scanf("%d", newSalary);
 			int i;
 			for (i = 0; i < numEmp; i++) {
-				if (db[i].id == *currId) // Locate Employee to be updated
-					updateEmp(&db[i], *newId, firstName, lastName, *newSalary);
+				if (db->ids[i] == *currId) { // Locate Employee to be updated
+					salaryIndexRemove(db->salaries[i], db->ids[i]);
+					updateEmp(db, i, *newId, firstName, lastName, *newSalary);
+					salaryIndexInsert(*newSalary, *newId);
+					Employee emp;
+					getRow(db, i, &emp);
+					walLog(WAL_UPDATE, *currId, &emp);
+				}
 			}
+			walCommit();
 			sortById(db, numEmp); // Sort database by ID once again
 		}
 		else if (*inpt == 7) { // Sort Employees by Last Name
@@ -172,11 +529,25 @@ Enter your choice: ");
 		else if (*inpt == 8) { // Sort Employees by ID
 			sortById(db, numEmp);
 		}
-		else { // If user enters number other than 1-8
-			printf("Invalid Entry.  Enter a value from 1 to 8.");
+		else if (*inpt == 9) { // Lookup by Salary Range
+			int min[1], max[1];
+			printf("Enter the minimum and maximum salary: ");
+			scanf("%d %d", min, max);
+			sortById(db, numEmp); // Index lookups need the ID order
+			printf("\n\n");
+			printSalaryRange(db, numEmp, *min, *max);
+		}
+		else { // If user enters number other than 1-9
+			printf("Invalid Entry.  Enter a value from 1 to 9.");
 			continue;
 		}
+		// Adds and updates grow the log here too, not just in batch mode
+		if (store.enabled && store.walBytes >= store.compactBytes)
+			startCompaction(db, numEmp);
+		pollCompaction(false);
 	}
+	storeClose();
+	freeTable(db);
 	printf("\nGoodbye.\n");
 	return 0;
 }
@@ -189,7 +560,7 @@ Enter your choice: ");
  * @param db The database
  * @return total number of employees contained in the database
  */
-int readFile(char *filename, Employee *db) {
+int readFile(char *filename, EmployeeTable *db) {
 	int ret = openFile(filename);
 	if (ret == -1) {
 		printf("Error: cannot open %s\n", filename);
@@ -210,11 +581,10 @@ int readFile(char *filename, Employee *db) {
 		if (ret) { break; }
 		ret = readInt(&salary);
 		if (ret == 0) { // stuff was read in okay
-			emp.id = id;
-			emp.salary = salary;
-			strcpy(emp.first, first);
-			strcpy(emp.last, last);
-			db[i] = emp;
+			makeEmployee(&emp, id, first, last, salary);
+			if (i == db->capacity)
+				growTable(db, db->capacity * 2);
+			setRow(db, i, &emp);
 			i++;	
 		}
 	}	
@@ -227,61 +597,98 @@ int readFile(char *filename, Employee *db) {
  * @param db The Employee database
  * @param numEmp The number of employees in the database
  */ 
-void printArray(Employee *db, int numEmp) {
+void printArray(EmployeeTable *db, int numEmp) {
 	int i;
 	for (i = 0; i < numEmp; i++) {
-		printf("%d %20s %20s %20d\n", db[i].id, db[i].first, 
-			db[i].last, db[i].salary);
+		printf("%d %20s %20s %20d\n", db->ids[i], nameAt(db, db->firsts[i]), 
+			nameAt(db, db->lasts[i]), db->salaries[i]);
 	}
 	printf("\nTotal Employees: %d", numEmp);
 }
 
-/* Sorts the database by ID number
+/* Sorts the database by ID number.  Only the ID array is compared; the rows
+ * are then moved into place in one pass.
  *
  * @param db The Employee database
  * @param numEmp The number of employees in the database
  */ 
-void sortById(Employee *db, int numEmp) {
-	int i, j;
-	for (i = 0; i < numEmp - 1; i++) {
-		for (j = 0; j < numEmp - i - 1; j++) {
-			if (db[j].id > db[j + 1].id) {
-				swap(&db[j], &db[j + 1]);
-			}
-		}	
-	} 
+void sortById(EmployeeTable *db, int numEmp) {
+	int i;
+	for (i = 1; i < numEmp; i++) { // nothing to do if already in order
+		if (db->ids[i - 1] > db->ids[i])
+			break;
+	}
+	if (i >= numEmp)
+		return;
+	int *order = malloc(numEmp * sizeof(int));
+	for (i = 0; i < numEmp; i++)
+		order[i] = i;
+	sortTable = db;
+	qsort(order, numEmp, sizeof(int), compareIds);
+	permute(db, order, numEmp);
+	free(order);
 }
-/* Sorts the database by Employees last name
+/* Sorts the database by Employees last name, then first name
  *
  * @param db The Employee database
  * @param numEmp The number of employees in the database
  */
-void sortByLast(Employee *db, int numEmp) {
-	int i, j;
-	for (i = 0; i < numEmp - 1; i++) {
-		for (j = 0; j < numEmp - i - 1; j++) {
-			int ret = strcasecmp(db[j].last, db[j + 1].last);
-			if (ret > 0) // Swap last names if necessary
-				swap(&db[j], &db[j + 1]);
-			else if (ret == 0) { // If same last name, check first
-				int ret2 = strcasecmp(db[j].first, db[j + 1].first);
-				if (ret2 > 0) 
-					swap(&db[j], &db[j + 1]);	
-			}
-		}
-	}
+void sortByLast(EmployeeTable *db, int numEmp) {
+	int *order = malloc(numEmp * sizeof(int));
+	for (int i = 0; i < numEmp; i++)
+		order[i] = i;
+	sortTable = db;
+	qsort(order, numEmp, sizeof(int), compareNames);
+	permute(db, order, numEmp);
+	free(order);
 }
 
-/* Helper method for sortById and sortByLast, swaps employee locations in
- * 		memory
+/* Helper method for sortById and sortByLast, rearranges the table's rows so
+ * 		that row i becomes the old row order[i]
  *
- * @param emp1 First Employee to be swapped
- * @param emp2 Second Employee to be swapped
+ * @param db The Employee database
+ * @param order New order of the rows
+ * @param numEmp The number of employees in the database
  */ 
-void swap(Employee *emp1, Employee *emp2) {
-	Employee temp = *emp1;
-	*emp1 = *emp2;
-	*emp2 = temp;
+void permute(EmployeeTable *db, int *order, int numEmp) {
+	int *ids = malloc(db->capacity * sizeof(int));
+	int *salaries = malloc(db->capacity * sizeof(int));
+	uint32_t *firsts = malloc(db->capacity * sizeof(uint32_t));
+	uint32_t *lasts = malloc(db->capacity * sizeof(uint32_t));
+	for (int i = 0; i < numEmp; i++) {
+		ids[i] = db->ids[order[i]];
+		salaries[i] = db->salaries[order[i]];
+		firsts[i] = db->firsts[order[i]];
+		lasts[i] = db->lasts[order[i]];
+	}
+	free(db->ids);
+	free(db->salaries);
+	free(db->firsts);
+	free(db->lasts);
+	db->ids = ids;
+	db->salaries = salaries;
+	db->firsts = firsts;
+	db->lasts = lasts;
+}
+
+/* Comparison function for qsort, orders row numbers of sortTable by ID.
+ */
+int compareIds(const void *a, const void *b) {
+	int id1 = sortTable->ids[*(const int *)a], id2 = sortTable->ids[*(const int *)b];
+	return (id1 > id2) - (id1 < id2);
+}
+
+/* Comparison function for qsort, orders row numbers of sortTable by last
+ * name and then first name, ignoring case.
+ */
+int compareNames(const void *a, const void *b) {
+	int i = *(const int *)a, j = *(const int *)b;
+	int ret = strcasecmp(nameAt(sortTable, sortTable->lasts[i]),
+			nameAt(sortTable, sortTable->lasts[j]));
+	if (ret == 0) // If same last name, check first
+		ret = strcasecmp(nameAt(sortTable, sortTable->firsts[i]),
+				nameAt(sortTable, sortTable->firsts[j]));
+	return ret;
 }
 
 /* Searches for employee in database using Binary Search based on ID.  
@@ -291,22 +698,12 @@ void swap(Employee *emp1, Employee *emp2) {
  * @param id The Employee's ID number
  * @param numEmp The number of employees in the database
  */ 
-void lookupById(Employee *db, int id, int numEmp) {
-	int first = 0, last = numEmp - 1, middle = (first + last) / 2;
-	while (first <= last) {
-		if (db[middle].id < id)
-			first = middle + 1;
-		else if (db[middle].id == id) {
-			printf("\n\nEmployee found:\nID: %d\nName: %s %s\nSalary: $%d\n\n", db[middle].id,\
-			db[middle].first, db[middle].last, db[middle].salary);
-			break;
-		}
-		else
-			last = middle - 1;
-
-		middle = (first + last) / 2;
-	}
-	if (first > last)
+void lookupById(EmployeeTable *db, int id, int numEmp) {
+	int i = findById(db, id, numEmp);
+	if (i != -1)
+		printf("\n\nEmployee found:\nID: %d\nName: %s %s\nSalary: $%d\n\n", db->ids[i],\
+		nameAt(db, db->firsts[i]), nameAt(db, db->lasts[i]), db->salaries[i]);
+	else
 		printf("\n\nEmployee not found.  Try again\n\n");
 }
 
@@ -317,13 +714,13 @@ void lookupById(Employee *db, int id, int numEmp) {
  * @param last Employee's last name
  * @param numEmp The number of employees in the database
  */ 
-void lookupByLast(Employee *db, char last[], int numEmp) {
+void lookupByLast(EmployeeTable *db, char last[], int numEmp) {
 	int i;
 	for (i = 0; i < numEmp; i++) {
-		int ret = strcasecmp(db[i].last, last);
+		int ret = strcasecmp(nameAt(db, db->lasts[i]), last);
 		if (ret == 0) {
-			printf("\n\nEmployee found:\nID: %d\nName: %s %s\nSalary: $%d\n\n", db[i].id,\
-			db[i].first, db[i].last, db[i].salary);
+			printf("\n\nEmployee found:\nID: %d\nName: %s %s\nSalary: $%d\n\n", db->ids[i],\
+			nameAt(db, db->firsts[i]), nameAt(db, db->lasts[i]), db->salaries[i]);
 			break;
 		}
 	}
@@ -331,7 +728,7 @@ void lookupByLast(Employee *db, char last[], int numEmp) {
 		printf("\n\nEmployee not found.\n\n");
 }
 
-/* Adds an employee to the database.
+/* Adds an employee to the database, keeping it sorted by ID.
  *
  * @param db The Employee database
  * @param numEmp The number of employees in the database
@@ -340,34 +737,1337 @@ void lookupByLast(Employee *db, char last[], int numEmp) {
  * @param last The Employee's last name
  * @param salary The Employee's salary
  */ 
-void addEmployee(Employee *db, int numEmp, int id, char first[], char last[], int salary) {
+void addEmployee(EmployeeTable *db, int numEmp, int id, char first[], char last[], int salary) {
 	Employee emp;
-	emp.id = id;
-	strcpy(emp.first, first);
-	strcpy(emp.last, last);
-	emp.salary = salary;
-	db[numEmp++] = emp;
-	sortById(db, numEmp);
+	makeEmployee(&emp, id, first, last, salary);
+	sortById(db, numEmp); // the menu may have sorted by last name
+	addSorted(db, numEmp, &emp);
 	printf("\n\nEmployee added to database.\n\n");
 }
 
 /* Updates an employee's information w/i the database.  Prints success message
  * 		when complete.
  * 
- * @param emp The Employee to be updated
+ * @param db The Employee database
+ * @param index Position of the Employee to be updated
  * @param id The Employee's new ID
  * @param first The Employee's new First Name
  * @param last The Employee's new Last Name
  * @param salary The Employee's new Salary
  */ 
-void updateEmp(Employee *emp, int id, char first[], char last[], int salary) {
-	(*emp).id = id;
-	strcpy((*emp).first, first);
-	strcpy((*emp).last, last);
-	(*emp).salary = salary;
+void updateEmp(EmployeeTable *db, int index, int id, char first[], char last[], int salary) {
+	Employee emp;
+	makeEmployee(&emp, id, first, last, salary);
+	setRow(db, index, &emp);
 	printf("\n\nEmployee information updated.\n\n");
 }
 
+/* Searches for employee in database using Binary Search based on ID.
+ *
+ * @param db The Employee database, sorted by ID
+ * @param id The Employee's ID number
+ * @param numEmp The number of employees in the database
+ * @return index of the employee in db, or -1 if not found
+ */
+int findById(EmployeeTable *db, int id, int numEmp) {
+	int *ids = db->ids;
+	int first = 0, last = numEmp - 1;
+	while (first <= last) {
+		int middle = first + (last - first) / 2;
+		if (ids[middle] < id)
+			first = middle + 1;
+		else if (ids[middle] > id)
+			last = middle - 1;
+		else
+			return middle;
+	}
+	return -1;
+}
+
+/* Inserts an employee at its sorted position in a database that is already
+ * sorted by ID, shifting the larger IDs up one slot.  Grows the table if it
+ * is full.
+ *
+ * @param db The Employee database, sorted by ID
+ * @param numEmp The number of employees in the database
+ * @param emp The Employee to be inserted
+ * @return new number of employees in the database
+ */
+int insertById(EmployeeTable *db, int numEmp, Employee *emp) {
+	if (numEmp == db->capacity)
+		growTable(db, db->capacity * 2);
+	int first = 0, last = numEmp;
+	while (first < last) { // find first slot with a larger ID
+		int middle = first + (last - first) / 2;
+		if (db->ids[middle] < emp->id)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	int moving = numEmp - first;
+	memmove(&db->ids[first + 1], &db->ids[first], moving * sizeof(int));
+	memmove(&db->salaries[first + 1], &db->salaries[first], moving * sizeof(int));
+	memmove(&db->firsts[first + 1], &db->firsts[first], moving * sizeof(uint32_t));
+	memmove(&db->lasts[first + 1], &db->lasts[first], moving * sizeof(uint32_t));
+	setRow(db, first, emp);
+	return numEmp + 1;
+}
+
+/* Removes the employee at index from the database, keeping the rest of the
+ * database in order.
+ *
+ * @param db The Employee database
+ * @param numEmp The number of employees in the database
+ * @param index Position of the Employee to be removed
+ * @return new number of employees in the database
+ */
+int removeAt(EmployeeTable *db, int numEmp, int index) {
+	int moving = numEmp - index - 1;
+	memmove(&db->ids[index], &db->ids[index + 1], moving * sizeof(int));
+	memmove(&db->salaries[index], &db->salaries[index + 1], moving * sizeof(int));
+	memmove(&db->firsts[index], &db->firsts[index + 1], moving * sizeof(uint32_t));
+	memmove(&db->lasts[index], &db->lasts[index + 1], moving * sizeof(uint32_t));
+	return numEmp - 1;
+}
+
+/* Sets up an empty employee table and name arena.
+ *
+ * @param db The table to set up
+ * @param capacity Number of rows to make room for
+ */
+void initTable(EmployeeTable *db, int capacity) {
+	memset(db, 0, sizeof(EmployeeTable));
+	growTable(db, capacity);
+	db->names.capacity = 4096;
+	db->names.bytes = malloc(db->names.capacity);
+	db->names.numSlots = 1024;
+	db->names.slots = malloc(db->names.numSlots * sizeof(uint32_t));
+	memset(db->names.slots, 0xff, db->names.numSlots * sizeof(uint32_t));
+}
+
+/* Frees everything the table owns.
+ */
+void freeTable(EmployeeTable *db) {
+	free(db->ids);
+	free(db->salaries);
+	free(db->firsts);
+	free(db->lasts);
+	free(db->names.bytes);
+	free(db->names.slots);
+}
+
+/* Grows the table's row arrays to hold capacity rows.  Exits if memory runs
+ * out.
+ *
+ * @param db The Employee database
+ * @param capacity New capacity
+ */
+void growTable(EmployeeTable *db, int capacity) {
+	db->capacity = capacity;
+	db->ids = realloc(db->ids, capacity * sizeof(int));
+	db->salaries = realloc(db->salaries, capacity * sizeof(int));
+	db->firsts = realloc(db->firsts, capacity * sizeof(uint32_t));
+	db->lasts = realloc(db->lasts, capacity * sizeof(uint32_t));
+	if (db->ids == NULL || db->salaries == NULL || db->firsts == NULL || db->lasts == NULL) {
+		printf("Error: out of memory growing database to %d employees\n", capacity);
+		exit(1);
+	}
+}
+
+/* Stores an employee in row index of the table, interning its names.
+ */
+void setRow(EmployeeTable *db, int index, Employee *emp) {
+	db->ids[index] = emp->id;
+	db->salaries[index] = emp->salary;
+	db->firsts[index] = internName(&db->names, emp->first);
+	db->lasts[index] = internName(&db->names, emp->last);
+}
+
+/* Copies row index of the table out into an Employee struct.
+ */
+void getRow(EmployeeTable *db, int index, Employee *emp) {
+	makeEmployee(emp, db->ids[index], nameAt(db, db->firsts[index]),
+			nameAt(db, db->lasts[index]), db->salaries[index]);
+}
+
+/* Returns the name stored at offset in the table's arena.  The pointer is
+ * only good until the next name is interned.
+ */
+char *nameAt(EmployeeTable *db, uint32_t offset) {
+	return db->names.bytes + offset;
+}
+
+/* Returns the arena offset of name, adding it to the arena if this is the
+ * first time it has been seen.
+ *
+ * @param names The name arena
+ * @param name NUL terminated name
+ * @return offset of the interned copy
+ */
+uint32_t internName(NameArena *names, char *name) {
+	uint32_t len = strlen(name);
+	uint32_t mask = names->numSlots - 1;
+	uint32_t slot = checksum(name, len) & mask;
+	while (names->slots[slot] != NOFFSET) {
+		if (strcmp(names->bytes + names->slots[slot], name) == 0)
+			return names->slots[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	// New name: append it to the arena
+	while (names->len + len + 1 > names->capacity) {
+		names->capacity *= 2;
+		names->bytes = realloc(names->bytes, names->capacity);
+		if (names->bytes == NULL) {
+			printf("Error: out of memory growing name arena\n");
+			exit(1);
+		}
+	}
+	uint32_t offset = names->len;
+	memcpy(names->bytes + offset, name, len + 1);
+	names->len += len + 1;
+	addNameSlot(names, offset);
+	return offset;
+}
+
+/* Records the name at offset in the arena's hash table, doubling the table
+ * when it gets half full.
+ */
+void addNameSlot(NameArena *names, uint32_t offset) {
+	if (2 * (names->count + 1) > names->numSlots) {
+		uint32_t *old = names->slots, oldSlots = names->numSlots;
+		names->numSlots *= 2;
+		names->slots = malloc(names->numSlots * sizeof(uint32_t));
+		memset(names->slots, 0xff, names->numSlots * sizeof(uint32_t));
+		names->count = 0;
+		for (uint32_t i = 0; i < oldSlots; i++) {
+			if (old[i] != NOFFSET)
+				addNameSlot(names, old[i]);
+		}
+		free(old);
+	}
+	uint32_t mask = names->numSlots - 1;
+	char *name = names->bytes + offset;
+	uint32_t slot = checksum(name, strlen(name)) & mask;
+	while (names->slots[slot] != NOFFSET)
+		slot = (slot + 1) & mask;
+	names->slots[slot] = offset;
+	names->count++;
+}
+
+/* Checks employee info against the same rules the interactive menu uses.
+ *
+ * @return true if the info is valid
+ */
+bool validEmployee(int id, char first[], char last[], int salary) {
+	return id >= MINID && id <= MAXID && salary >= 30000 && salary <= 150000
+		&& first[0] != '\0' && last[0] != '\0';
+}
+
+/* Seconds elapsed on the monotonic clock since start.
+ */
+double elapsedSeconds(struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Runs the commands in cmdfile against the database without printing the
+ * menu or any prompts.  Results go to stdout through a large buffer, one line
+ * per result; errors go to stderr tagged with their line number.  When the
+ * file is done the number of queries and queries/sec are printed to stderr.
+ *
+ * @param cmdfile File of commands, or "-" for stdin
+ * @param db The Employee database, sorted by ID
+ * @param numEmp The number of employees in the database
+ * @return new number of employees in the database
+ */
+int runBatch(char *cmdfile, EmployeeTable *db, int numEmp) {
+	FILE *in = stdin;
+	if (strcmp(cmdfile, "-") != 0 && (in = fopen(cmdfile, "r")) == NULL) {
+		printf("Error: cannot open %s\n", cmdfile);
+		exit(1);
+	}
+	setvbuf(in, NULL, _IOFBF, BATCHBUF);
+	setvbuf(stdout, NULL, _IOFBF, BATCHBUF);
+
+	char line[MAXCMDLINE], cmd[MAXNAME], first[MAXNAME], last[MAXNAME];
+	long queries = 0, mutations = 0, lineNum = 0;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (fgets(line, MAXCMDLINE, in) != NULL) {
+		lineNum++;
+		int id, newId, salary, i;
+		if (sscanf(line, "%63s", cmd) != 1)
+			continue; // blank line
+		queries++;
+
+		if (strcmp(cmd, "id") == 0 && sscanf(line, "%*s %d", &id) == 1) {
+			i = findById(db, id, numEmp);
+			if (i == -1)
+				printf("not found\n");
+			else
+				printRow(db, i);
+		}
+		else if (strcmp(cmd, "last") == 0 && sscanf(line, "%*s %63s", last) == 1) {
+			for (i = 0; i < numEmp; i++) {
+				if (strcasecmp(nameAt(db, db->lasts[i]), last) == 0)
+					break;
+			}
+			if (i == numEmp)
+				printf("not found\n");
+			else
+				printRow(db, i);
+		}
+		else if (strcmp(cmd, "add") == 0 && sscanf(line, "%*s %d %63s %63s %d",
+					&id, first, last, &salary) == 4) {
+			if (!validEmployee(id, first, last, salary))
+				fprintf(stderr, "error: line %ld: invalid employee info\n", lineNum);
+			else if (findById(db, id, numEmp) != -1)
+				fprintf(stderr, "error: line %ld: ID %d already exists\n", lineNum, id);
+			else {
+				Employee emp;
+				makeEmployee(&emp, id, first, last, salary);
+				numEmp = addSorted(db, numEmp, &emp);
+				walLog(WAL_ADD, 0, &emp);
+				mutations++;
+			}
+		}
+		else if (strcmp(cmd, "update") == 0 && sscanf(line, "%*s %d %d %63s %63s %d",
+					&id, &newId, first, last, &salary) == 5) {
+			i = findById(db, id, numEmp);
+			if (i == -1)
+				fprintf(stderr, "error: line %ld: ID %d not found\n", lineNum, id);
+			else if (!validEmployee(newId, first, last, salary))
+				fprintf(stderr, "error: line %ld: invalid employee info\n", lineNum);
+			else if (newId != id && findById(db, newId, numEmp) != -1)
+				fprintf(stderr, "error: line %ld: ID %d already exists\n", lineNum, newId);
+			else {
+				Employee emp;
+				makeEmployee(&emp, newId, first, last, salary);
+				numEmp = updateAt(db, numEmp, i, &emp);
+				walLog(WAL_UPDATE, id, &emp);
+				mutations++;
+			}
+		}
+		else if (strcmp(cmd, "dump") == 0) {
+			for (i = 0; i < numEmp; i++)
+				printRow(db, i);
+		}
+		else if (strcmp(cmd, "compact") == 0) {
+			startCompaction(db, numEmp);
+		}
+		else if (strcmp(cmd, "range") == 0 && sscanf(line, "%*s %d %d", &id, &salary) == 2) {
+			printSalaryRange(db, numEmp, id, salary);
+		}
+		else if (strcmp(cmd, "top") == 0 && sscanf(line, "%*s %d", &id) == 1) {
+			printTopSalaries(db, numEmp, id);
+		}
+		else if (strcmp(cmd, "pct") == 0 && sscanf(line, "%*s %63s", first) == 1) {
+			if (numEmp == 0)
+				printf("not found\n");
+			else
+				printf("%d\n", salaryPercentile(atof(first)));
+		}
+		else if (strcmp(cmd, "bands") == 0 && sscanf(line, "%*s %d", &id) == 1 && id > 0) {
+			printSalaryBands(id);
+		}
+		else {
+			fprintf(stderr, "error: line %ld: bad command: %s", lineNum, line);
+			queries--;
+		}
+		if (store.enabled && store.walBytes >= store.compactBytes)
+			startCompaction(db, numEmp);
+		pollCompaction(false);
+	}
+	walCommit();
+	fflush(stdout);
+	double secs = elapsedSeconds(&start);
+	fprintf(stderr, "batch: %ld queries in %.3f s (%.0f queries/sec)\n",
+			queries, secs, secs > 0 ? queries / secs : 0.0);
+	if (mutations > 0)
+		fprintf(stderr, "batch: %ld mutations (%.0f mutations/sec, %ld log commits)\n",
+				mutations, secs > 0 ? mutations / secs : 0.0, store.commits);
+	printMemoryUse(db, numEmp);
+	if (in != stdin)
+		fclose(in);
+	return numEmp;
+}
+
+/* Fills in an Employee struct.
+ */
+void makeEmployee(Employee *emp, int id, char first[], char last[], int salary) {
+	memset(emp, 0, sizeof(Employee)); // keep padding out of the log checksums
+	emp->id = id;
+	emp->salary = salary;
+	strcpy(emp->first, first);
+	strcpy(emp->last, last);
+}
+
+/* Adds an employee to a database sorted by ID, keeping the salary index in
+ * sync.
+ *
+ * @return new number of employees in the database
+ */
+int addSorted(EmployeeTable *db, int numEmp, Employee *emp) {
+	salaryIndexInsert(emp->salary, emp->id);
+	return insertById(db, numEmp, emp);
+}
+
+/* Replaces the employee at index, moving it if its ID changed so the
+ * database stays sorted by ID.
+ *
+ * @return number of employees in the database
+ */
+int updateAt(EmployeeTable *db, int numEmp, int index, Employee *emp) {
+	salaryIndexRemove(db->salaries[index], db->ids[index]);
+	salaryIndexInsert(emp->salary, emp->id);
+	if (db->ids[index] == emp->id) {
+		setRow(db, index, emp);
+		return numEmp;
+	}
+	numEmp = removeAt(db, numEmp, index);
+	return insertById(db, numEmp, emp);
+}
+
+/* Prints one employee as a single space separated line for batch output.
+ */
+void printRow(EmployeeTable *db, int index) {
+	printf("%d %s %s %d\n", db->ids[index], nameAt(db, db->firsts[index]),
+			nameAt(db, db->lasts[index]), db->salaries[index]);
+}
+
+/* Prints how much memory the table uses in total and per employee to stderr.
+ */
+void printMemoryUse(EmployeeTable *db, int numEmp) {
+	size_t rowBytes = 2 * sizeof(int) + 2 * sizeof(uint32_t);
+	size_t bytes = numEmp * rowBytes + db->names.len + db->names.count * sizeof(uint32_t);
+	fprintf(stderr, "table: %d employees, %d distinct names, %zu bytes "
+			"(%.1f bytes/employee, %zu as Employee structs)\n",
+			numEmp, db->names.count, bytes, numEmp > 0 ? (double)bytes / numEmp : 0.0,
+			numEmp * sizeof(Employee));
+}
+
+//-----------------------------------------Salary Index---------------------------------------------
+
+/* Comparison function for qsort, orders salary keys by salary then ID.
+ */
+int compareSalaryKeys(const void *a, const void *b) {
+	const SalaryKey *k1 = a, *k2 = b;
+	if (k1->salary != k2->salary)
+		return (k1->salary > k2->salary) - (k1->salary < k2->salary);
+	return (k1->id > k2->id) - (k1->id < k2->id);
+}
+
+/* Builds the salary index from scratch.  After this, every add and update
+ * keeps it current.
+ *
+ * @param db The Employee database
+ * @param numEmp The number of employees in the database
+ */
+void buildSalaryIndex(EmployeeTable *db, int numEmp) {
+	salaryIndex.capacity = numEmp > MAXEMPLOYEE ? numEmp : MAXEMPLOYEE;
+	salaryIndex.keys = malloc(salaryIndex.capacity * sizeof(SalaryKey));
+	for (int i = 0; i < numEmp; i++) {
+		salaryIndex.keys[i].salary = db->salaries[i];
+		salaryIndex.keys[i].id = db->ids[i];
+	}
+	salaryIndex.n = numEmp;
+	qsort(salaryIndex.keys, numEmp, sizeof(SalaryKey), compareSalaryKeys);
+}
+
+/* Finds the first position in the index whose key is not less than
+ * (salary, id).
+ *
+ * @return position in salaryIndex.keys, from 0 to salaryIndex.n
+ */
+int salaryLowerBound(int salary, int id) {
+	SalaryKey key = {salary, id};
+	int first = 0, last = salaryIndex.n;
+	while (first < last) {
+		int middle = first + (last - first) / 2;
+		if (compareSalaryKeys(&salaryIndex.keys[middle], &key) < 0)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	return first;
+}
+
+/* Adds an employee's salary to the index.  Does nothing until the index has
+ * been built, so log replay at startup does not pay for it.
+ */
+void salaryIndexInsert(int salary, int id) {
+	if (salaryIndex.keys == NULL)
+		return;
+	if (salaryIndex.n == salaryIndex.capacity) {
+		salaryIndex.capacity *= 2;
+		salaryIndex.keys = realloc(salaryIndex.keys, salaryIndex.capacity * sizeof(SalaryKey));
+	}
+	int pos = salaryLowerBound(salary, id);
+	memmove(&salaryIndex.keys[pos + 1], &salaryIndex.keys[pos],
+			(salaryIndex.n - pos) * sizeof(SalaryKey));
+	salaryIndex.keys[pos].salary = salary;
+	salaryIndex.keys[pos].id = id;
+	salaryIndex.n++;
+}
+
+/* Removes an employee's salary from the index.
+ */
+void salaryIndexRemove(int salary, int id) {
+	if (salaryIndex.keys == NULL)
+		return;
+	int pos = salaryLowerBound(salary, id);
+	if (pos == salaryIndex.n || salaryIndex.keys[pos].salary != salary
+			|| salaryIndex.keys[pos].id != id)
+		return;
+	memmove(&salaryIndex.keys[pos], &salaryIndex.keys[pos + 1],
+			(salaryIndex.n - pos - 1) * sizeof(SalaryKey));
+	salaryIndex.n--;
+}
+
+/* Prints every employee with min <= salary <= max in salary order, followed
+ * by the count.
+ *
+ * @param db The Employee database, sorted by ID
+ * @param numEmp The number of employees in the database
+ */
+void printSalaryRange(EmployeeTable *db, int numEmp, int min, int max) {
+	int lo = salaryLowerBound(min, 0);
+	int hi = max < min ? lo : salaryLowerBound(max, MAXID + 1); // past any ID at max
+	for (int i = lo; i < hi; i++)
+		printRow(db, findById(db, salaryIndex.keys[i].id, numEmp));
+	printf("count %d\n", hi - lo);
+}
+
+/* Prints the k highest paid employees, highest first.
+ *
+ * @param db The Employee database, sorted by ID
+ * @param numEmp The number of employees in the database
+ */
+void printTopSalaries(EmployeeTable *db, int numEmp, int k) {
+	for (int i = salaryIndex.n - 1; i >= 0 && i >= salaryIndex.n - k; i--)
+		printRow(db, findById(db, salaryIndex.keys[i].id, numEmp));
+}
+
+/* Returns the salary at the given percentile (nearest rank).  The index
+ * must not be empty.
+ *
+ * @param pct Percentile from 0 to 100
+ */
+int salaryPercentile(double pct) {
+	if (pct < 0)
+		pct = 0;
+	if (pct > 100)
+		pct = 100;
+	int rank = (int)(pct / 100 * salaryIndex.n + 0.999999);
+	return salaryIndex.keys[rank > 0 ? rank - 1 : 0].salary;
+}
+
+/* Prints the number of employees in each salary band of the given width,
+ * from the lowest salary's band to the highest's.  Band edges are longs so
+ * a width near INT_MAX can't overflow them.
+ */
+void printSalaryBands(int width) {
+	if (salaryIndex.n == 0)
+		return;
+	long band = salaryIndex.keys[0].salary / width * (long)width;
+	int top = salaryIndex.keys[salaryIndex.n - 1].salary;
+	for (; band <= top; band += width) {
+		long next = band + width;
+		int count = (next > top ? salaryIndex.n : salaryLowerBound(next, 0)) - salaryLowerBound(band, 0);
+		printf("%ld-%ld %d\n", band, next - 1, count);
+	}
+}
+
+//----------------------------------------Durable Storage-------------------------------------------
+
+/* FNV-1a hash, used to catch torn or corrupt records on disk.
+ */
+uint32_t checksum(void *data, size_t len) {
+	unsigned char *bytes = data;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Writes all of buf to fd, retrying short writes.
+ *
+ * @return 0 on success, -1 on error
+ */
+int writeAll(int fd, void *buf, size_t len) {
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Sets up the durable store file names and commit policy.
+ *
+ * @param filename The text database file the store files are named after
+ * @param policy "always" (fsync every change), "group" (fsync once per group
+ * 		of changes) or "none" (leave flushing to the OS)
+ * @param groupSize Number of changes per group commit
+ * @param compactBytes Log size that triggers a background compaction
+ */
+void storeInit(char *filename, char *policy, int groupSize, long compactBytes) {
+	if (strcmp(policy, "always") == 0)
+		store.policy = FSYNC_ALWAYS;
+	else if (strcmp(policy, "group") == 0)
+		store.policy = FSYNC_GROUP;
+	else if (strcmp(policy, "none") == 0)
+		store.policy = FSYNC_NONE;
+	else {
+		printf("Error: unknown fsync policy %s (use always, group or none)\n", policy);
+		exit(1);
+	}
+	store.enabled = true;
+	store.groupSize = (store.policy == FSYNC_ALWAYS || groupSize < 1) ? 1 : groupSize;
+	store.compactBytes = compactBytes;
+	store.pending = malloc(store.groupSize * sizeof(WalRecord));
+	snprintf(store.snapPath, MAXPATH, "%s.snap", filename);
+	snprintf(store.tmpPath, MAXPATH, "%s.snap.tmp", filename);
+	snprintf(store.walPath, MAXPATH, "%s.wal", filename);
+	snprintf(store.oldWalPath, MAXPATH, "%s.wal.old", filename);
+}
+
+/* Rebuilds the database from the snapshot (or the text file if there is no
+ * snapshot yet) plus every logged change made since, then opens the log for
+ * appending.  Prints how long recovery took to stderr.
+ *
+ * @param filename The text database file
+ * @param db The Employee database
+ * @return number of employees in the database
+ */
+int storeRecover(char *filename, EmployeeTable *db) {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	uint64_t snapSeq = 0;
+	long replayed = 0;
+	int numEmp = loadSnapshot(db, &snapSeq);
+	bool fromSnap = numEmp != -1;
+	if (!fromSnap)
+		numEmp = readFile(filename, db);
+	sortById(db, numEmp); // snapshots keep whatever order the database was in
+	store.seq = snapSeq;
+	// A leftover old log means a compaction did not finish; replay it first
+	numEmp = replayWal(store.oldWalPath, db, numEmp, snapSeq, &replayed, false);
+	numEmp = replayWal(store.walPath, db, numEmp, snapSeq, &replayed, true);
+
+	store.walFd = open(store.walPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (store.walFd == -1) {
+		printf("Error: cannot open %s\n", store.walPath);
+		exit(1);
+	}
+	struct stat st;
+	fstat(store.walFd, &st);
+	store.walBytes = st.st_size;
+
+	fprintf(stderr, "recovery: %d employees from %s + %ld log records in %.3f ms\n",
+			numEmp, fromSnap ? "snapshot" : "text file", replayed,
+			elapsedSeconds(&start) * 1000);
+	return numEmp;
+}
+
+/* Loads the snapshot file into the database with a single mmap and a copy
+ * of each array.  Version 1 snapshots of Employee structs are converted.
+ *
+ * @param db The Employee database
+ * @param seq Set to the last log sequence number in the snapshot
+ * @return number of employees loaded, or -1 if there is no usable snapshot
+ */
+int loadSnapshot(EmployeeTable *db, uint64_t *seq) {
+	int fd = open(store.snapPath, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(SnapHeader)) {
+		close(fd);
+		return -1;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	SnapHeader *hdr = map;
+	char *body = (char *)(hdr + 1);
+	size_t rowBytes = 2 * sizeof(int) + 2 * sizeof(uint32_t);
+	size_t bytes = hdr->version == 1 ? (size_t)hdr->count * sizeof(Employee)
+		: (size_t)hdr->count * rowBytes + hdr->extra;
+	if (memcmp(hdr->magic, SNAPMAGIC, sizeof(SNAPMAGIC)) != 0
+			|| (hdr->version != 1 && hdr->version != SNAPVERSION)
+			|| (hdr->version == 1 && hdr->extra != sizeof(Employee))
+			|| sizeof(SnapHeader) + bytes != (size_t)st.st_size
+			|| checksum(body, bytes) != hdr->checksum) {
+		fprintf(stderr, "warning: ignoring corrupt snapshot %s\n", store.snapPath);
+		munmap(map, st.st_size);
+		return -1;
+	}
+	int numEmp = hdr->count;
+	if (numEmp > db->capacity)
+		growTable(db, numEmp);
+	if (hdr->version == 1) {
+		Employee *recs = (Employee *)body;
+		for (int i = 0; i < numEmp; i++)
+			setRow(db, i, &recs[i]);
+	}
+	else {
+		memcpy(db->ids, body, numEmp * sizeof(int));
+		body += numEmp * sizeof(int);
+		memcpy(db->salaries, body, numEmp * sizeof(int));
+		body += numEmp * sizeof(int);
+		memcpy(db->firsts, body, numEmp * sizeof(uint32_t));
+		body += numEmp * sizeof(uint32_t);
+		memcpy(db->lasts, body, numEmp * sizeof(uint32_t));
+		body += numEmp * sizeof(uint32_t);
+
+		// Take the arena as is and rebuild its hash table
+		NameArena *names = &db->names;
+		while (names->capacity < hdr->extra)
+			names->capacity *= 2;
+		names->bytes = realloc(names->bytes, names->capacity);
+		memcpy(names->bytes, body, hdr->extra);
+		names->len = hdr->extra;
+		for (uint32_t offset = 0; offset < names->len;
+				offset += strlen(names->bytes + offset) + 1)
+			addNameSlot(names, offset);
+	}
+	*seq = hdr->seq;
+	munmap(map, st.st_size);
+	return numEmp;
+}
+
+/* Applies every valid record in a log file that is newer than the snapshot.
+ * Reading stops at the first torn or corrupt record; for the active log the
+ * file is cut back to that point so new records follow a clean tail.
+ *
+ * @param path Log file to replay (a missing file is not an error)
+ * @param db The Employee database
+ * @param numEmp The number of employees in the database
+ * @param snapSeq Records at or below this sequence number are skipped
+ * @param replayed Incremented for every record applied
+ * @param truncateTail Whether to cut off a bad tail
+ * @return new number of employees in the database
+ */
+int replayWal(char *path, EmployeeTable *db, int numEmp, uint64_t snapSeq,
+		long *replayed, bool truncateTail) {
+	int fd = open(path, truncateTail ? O_RDWR : O_RDONLY);
+	if (fd == -1)
+		return numEmp;
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return numEmp;
+	}
+	WalRecord *recs = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (recs == MAP_FAILED) {
+		close(fd);
+		return numEmp;
+	}
+
+	long numRecs = st.st_size / sizeof(WalRecord), i;
+	for (i = 0; i < numRecs; i++) {
+		WalRecord *rec = &recs[i];
+		if (rec->checksum != checksum((char *)rec + sizeof(uint32_t),
+					sizeof(WalRecord) - sizeof(uint32_t)))
+			break;
+		if (rec->seq > store.seq)
+			store.seq = rec->seq;
+		if (rec->seq <= snapSeq)
+			continue;
+		if (rec->op == WAL_ADD)
+			numEmp = addSorted(db, numEmp, &rec->emp);
+		else if (rec->op == WAL_UPDATE) {
+			int index = findById(db, rec->currId, numEmp);
+			if (index != -1)
+				numEmp = updateAt(db, numEmp, index, &rec->emp);
+		}
+		(*replayed)++;
+	}
+	off_t good = i * sizeof(WalRecord);
+	if (truncateTail && good != st.st_size) {
+		fprintf(stderr, "warning: discarding %ld bytes of torn log tail in %s\n",
+				(long)(st.st_size - good), path);
+		// Appending after a tail we could not cut off would bury every new
+		// record behind it, so give up rather than open the log for writing
+		if (ftruncate(fd, good) == -1) {
+			perror("Error: truncating log");
+			exit(1);
+		}
+	}
+	munmap(recs, st.st_size);
+	close(fd);
+	return numEmp;
+}
+
+/* Queues a change for the write-ahead log.  The change becomes durable at
+ * the next group commit, which happens once groupSize changes are queued
+ * (right away under the "always" policy).  Does nothing unless the store
+ * is enabled.
+ *
+ * @param op WAL_ADD or WAL_UPDATE
+ * @param currId ID of the employee being updated
+ * @param emp The new employee info
+ */
+void walLog(int op, int currId, Employee *emp) {
+	if (!store.enabled)
+		return;
+	WalRecord *rec = &store.pending[store.numPending++];
+	memset(rec, 0, sizeof(WalRecord));
+	rec->op = op;
+	rec->seq = ++store.seq;
+	rec->currId = currId;
+	rec->emp = *emp;
+	rec->checksum = checksum((char *)rec + sizeof(uint32_t),
+			sizeof(WalRecord) - sizeof(uint32_t));
+	if (store.numPending >= store.groupSize)
+		walCommit();
+}
+
+/* Writes every queued change to the log with one write, then fsyncs it
+ * unless the policy is "none".
+ */
+void walCommit() {
+	if (!store.enabled || store.numPending == 0)
+		return;
+	size_t len = store.numPending * sizeof(WalRecord);
+	if (writeAll(store.walFd, store.pending, len) == -1) {
+		perror("Error: writing log");
+		exit(1);
+	}
+	if (store.policy != FSYNC_NONE)
+		fdatasync(store.walFd);
+	store.walBytes += len;
+	store.numPending = 0;
+	store.commits++;
+}
+
+/* Starts compacting the log into a new snapshot in the background.  The
+ * current log is set aside as the old log and a fresh one started.  The
+ * database is packed into the snapshot's buffer here, which is a copy of
+ * each array, and a thread then writes and fsyncs it while the caller keeps
+ * going.  (Forking instead is unsafe once the server has other threads.)
+ * Once the thread succeeds the old log is deleted (see pollCompaction).
+ *
+ * @param db The Employee database
+ * @param numEmp The number of employees in the database
+ */
+void startCompaction(EmployeeTable *db, int numEmp) {
+	if (!store.enabled || store.compacting)
+		return;
+	walCommit();
+	fsync(store.walFd);
+
+	// If an earlier compaction failed the old log is still needed, so keep
+	// it and let this snapshot cover both logs' records by sequence number.
+	if (access(store.oldWalPath, F_OK) == -1) {
+		close(store.walFd);
+		rename(store.walPath, store.oldWalPath);
+		store.walFd = open(store.walPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (store.walFd == -1) {
+			printf("Error: cannot open %s\n", store.walPath);
+			exit(1);
+		}
+	}
+	store.walBytes = 0;
+
+	store.snapBody = packSnapshot(db, numEmp, store.seq, &store.snapHdr, &store.snapLen);
+	if (store.snapBody == NULL) {
+		fprintf(stderr, "warning: no memory for compaction, keeping %s\n", store.oldWalPath);
+		return;
+	}
+	atomic_store(&store.compactDone, 0);
+	if (pthread_create(&store.compactThread, NULL, compactionFunc, NULL) != 0) {
+		fprintf(stderr, "warning: cannot start compaction, keeping %s\n", store.oldWalPath);
+		free(store.snapBody);
+		return;
+	}
+	store.compacting = true;
+}
+
+/* Thread that writes the snapshot packed by startCompaction.
+ *
+ * @param arg UNUSED PARAMETER
+ */
+void *compactionFunc(__attribute__ ((unused)) void *arg) {
+	store.compactResult = writeSnapshot(&store.snapHdr, store.snapBody, store.snapLen);
+	free(store.snapBody);
+	atomic_store(&store.compactDone, 1);
+	return NULL;
+}
+
+/* Checks on the background compaction, deleting the old log once the new
+ * snapshot is safely in place.
+ *
+ * @param block Whether to wait for a running compaction to finish
+ */
+void pollCompaction(bool block) {
+	if (!store.compacting || (!block && !atomic_load(&store.compactDone)))
+		return;
+	pthread_join(store.compactThread, NULL);
+	store.compacting = false;
+	if (store.compactResult == 0)
+		unlink(store.oldWalPath);
+	else
+		fprintf(stderr, "warning: compaction failed, keeping %s\n", store.oldWalPath);
+}
+
+/* Packs the database into a snapshot: fills in the header and copies the
+ * arrays into one buffer for writeSnapshot.
+ *
+ * @param db The Employee database
+ * @param numEmp The number of employees in the database
+ * @param seq Last log sequence number reflected in db
+ * @param hdr Filled in with the snapshot header
+ * @param bytes Set to the length of the returned buffer
+ * @return the snapshot body, to be freed by the caller, or NULL if out of memory
+ */
+char *packSnapshot(EmployeeTable *db, int numEmp, uint64_t seq, SnapHeader *hdr,
+		size_t *bytes) {
+	memset(hdr, 0, sizeof(SnapHeader));
+	memcpy(hdr->magic, SNAPMAGIC, sizeof(SNAPMAGIC));
+	hdr->version = SNAPVERSION;
+	hdr->count = numEmp;
+	hdr->seq = seq;
+	hdr->extra = db->names.len;
+
+	// Lay the arrays out back to back so the checksum covers one buffer
+	size_t rowBytes = 2 * sizeof(int) + 2 * sizeof(uint32_t);
+	*bytes = numEmp * rowBytes + db->names.len;
+	char *body = malloc(*bytes), *p = body;
+	if (body == NULL)
+		return NULL;
+	memcpy(p, db->ids, numEmp * sizeof(int));
+	p += numEmp * sizeof(int);
+	memcpy(p, db->salaries, numEmp * sizeof(int));
+	p += numEmp * sizeof(int);
+	memcpy(p, db->firsts, numEmp * sizeof(uint32_t));
+	p += numEmp * sizeof(uint32_t);
+	memcpy(p, db->lasts, numEmp * sizeof(uint32_t));
+	p += numEmp * sizeof(uint32_t);
+	memcpy(p, db->names.bytes, db->names.len);
+	hdr->checksum = checksum(body, *bytes);
+	return body;
+}
+
+/* Writes a packed snapshot to a temporary file, fsyncs it and then renames
+ * it over the old snapshot so a crash never leaves a partial one.
+ *
+ * @param hdr The snapshot header
+ * @param body The snapshot body from packSnapshot
+ * @param bytes Length of body
+ * @return 0 on success, -1 on error
+ */
+int writeSnapshot(SnapHeader *hdr, char *body, size_t bytes) {
+	int fd = open(store.tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return -1;
+	int ret = writeAll(fd, hdr, sizeof(SnapHeader)) == -1 || writeAll(fd, body, bytes) == -1
+		|| fsync(fd) == -1 ? -1 : 0;
+	close(fd);
+	if (ret == -1)
+		return -1;
+	return rename(store.tmpPath, store.snapPath);
+}
+
+/* Commits anything still queued, waits for a running compaction and closes
+ * the log.
+ */
+void storeClose() {
+	if (!store.enabled)
+		return;
+	walCommit();
+	pollCompaction(true);
+	close(store.walFd);
+	free(store.pending);
+	store.enabled = false;
+}
+
+//-----------------------------------------Server Mode----------------------------------------------
+
+/* Reads exactly len bytes from fd.
+ *
+ * @return 0 on success, -1 on error or end of file
+ */
+int readAll(int fd, void *buf, size_t len) {
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Signal handler that asks the server's accept loop to stop.
+ *
+ * @param sig UNUSED PARAMETER
+ */
+void stopHandler(__attribute__ ((unused)) int sig) {
+	stopServer = 1;
+}
+
+/* Serves the database on a Unix-domain socket until SIGINT or SIGTERM.
+ * Each client connection gets its own thread.  server.lock prefers
+ * writers, so a steady stream of lookups can't hold off adds and updates
+ * forever.  When the durable store is enabled a flusher thread group
+ * commits the log every FLUSH_USEC, so writes from many clients share one
+ * fsync.  It returns still holding
+ * server.lock for writing, so no connection thread can touch the table
+ * after the caller frees it.
+ *
+ * @param sockPath Path of the socket to create
+ * @param db The Employee database
+ * @param numEmp The number of employees in the database
+ */
+void runServer(char *sockPath, EmployeeTable *db, int *numEmp) {
+	server.db = db;
+	server.numEmp = *numEmp;
+	pthread_rwlockattr_t lockAttr;
+	pthread_rwlockattr_init(&lockAttr);
+	pthread_rwlockattr_setkind_np(&lockAttr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&server.lock, &lockAttr);
+	pthread_rwlockattr_destroy(&lockAttr);
+
+	int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (listenfd == -1 || strlen(sockPath) >= sizeof(addr.sun_path)) {
+		printf("Error: cannot create socket %s\n", sockPath);
+		exit(1);
+	}
+	strcpy(addr.sun_path, sockPath);
+	unlink(sockPath);
+	if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+			|| listen(listenfd, 128) == -1) {
+		perror("Error: bind");
+		exit(1);
+	}
+
+	// Stop cleanly on ^C so the log gets its final commit.  SIGINT and SIGTERM
+	// are blocked before any thread starts, so every thread inherits the block
+	// and only the accept loop takes them: pselect lets them through while it
+	// waits, so a signal cannot slip in between the stopServer check and the
+	// wait either.
+	sigset_t stopSigs, origMask, waitMask;
+	sigemptyset(&stopSigs);
+	sigaddset(&stopSigs, SIGINT);
+	sigaddset(&stopSigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stopSigs, &origMask);
+	waitMask = origMask;
+	sigdelset(&waitMask, SIGINT);
+	sigdelset(&waitMask, SIGTERM);
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stopHandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_t flusher;
+	if (store.enabled)
+		pthread_create(&flusher, NULL, flusherFunc, NULL);
+	fprintf(stderr, "server: serving %d employees on %s\n", server.numEmp, sockPath);
+
+	while (!stopServer) {
+		fd_set ready;
+		FD_ZERO(&ready);
+		FD_SET(listenfd, &ready);
+		if (pselect(listenfd + 1, &ready, NULL, NULL, NULL, &waitMask) <= 0)
+			continue;
+		int connfd = accept(listenfd, NULL, NULL);
+		if (connfd == -1)
+			continue;
+		pthread_t tid;
+		if (pthread_create(&tid, NULL, connectionFunc, (void *)(intptr_t)connfd) != 0) {
+			close(connfd);
+			continue;
+		}
+		pthread_detach(tid);
+	}
+	if (store.enabled)
+		pthread_join(flusher, NULL);
+	pthread_sigmask(SIG_SETMASK, &origMask, NULL);
+
+	// Connection threads may still be mid-request, so take the write lock and
+	// deliberately never release it.  The caller's final log commit and
+	// freeing of the table then run with no request in flight, and any
+	// connection thread that comes back for the lock stays blocked on it
+	// until the process exits instead of touching the freed table.
+	pthread_rwlock_wrlock(&server.lock);
+	*numEmp = server.numEmp;
+	close(listenfd);
+	unlink(sockPath);
+	fprintf(stderr, "server: shutting down with %d employees\n", *numEmp);
+}
+
+/* Thread that group commits the log and starts compactions for the server.
+ *
+ * @param arg UNUSED PARAMETER
+ */
+void *flusherFunc(__attribute__ ((unused)) void *arg) {
+	while (!stopServer) {
+		usleep(FLUSH_USEC);
+		pthread_rwlock_wrlock(&server.lock);
+		walCommit();
+		if (store.walBytes >= store.compactBytes)
+			startCompaction(server.db, server.numEmp);
+		pollCompaction(false);
+		pthread_rwlock_unlock(&server.lock);
+	}
+	return NULL;
+}
+
+/* Thread that answers requests on one client connection until the client
+ * hangs up.
+ *
+ * @param arg The connected socket's file descriptor
+ */
+void *connectionFunc(void *arg) {
+	int connfd = (int)(intptr_t)arg;
+	Request req;
+	Response res;
+	char names[2 * MAXNAME], outNames[2 * MAXNAME];
+
+	while (readAll(connfd, &req, sizeof(req)) == 0) {
+		if (req.firstLen >= MAXNAME || req.lastLen >= MAXNAME
+				|| readAll(connfd, names, req.firstLen + req.lastLen) == -1)
+			break;
+		handleRequest(&req, names, &res, outNames);
+		if (writeAll(connfd, &res, sizeof(res)) == -1
+				|| writeAll(connfd, outNames, res.firstLen + res.lastLen) == -1)
+			break;
+	}
+	close(connfd);
+	return NULL;
+}
+
+/* Runs one request against the shared database, taking the read lock for
+ * lookups and the write lock for changes.
+ *
+ * @param req The request
+ * @param names The request's first and last name bytes
+ * @param res Filled in with the response
+ * @param outNames Filled in with the response's name bytes
+ */
+void handleRequest(Request *req, char *names, Response *res, char *outNames) {
+	char first[MAXNAME], last[MAXNAME];
+	memcpy(first, names, req->firstLen);
+	first[req->firstLen] = '\0';
+	memcpy(last, names + req->firstLen, req->lastLen);
+	last[req->lastLen] = '\0';
+	memset(res, 0, sizeof(Response));
+
+	int i = -1;
+	if (req->op == REQ_ID || req->op == REQ_LAST) {
+		pthread_rwlock_rdlock(&server.lock);
+		if (req->op == REQ_ID)
+			i = findById(server.db, req->id, server.numEmp);
+		else {
+			// First match in ID order, as the menu and batch lookups return
+			for (i = 0; i < server.numEmp; i++) {
+				if (strcasecmp(nameAt(server.db, server.db->lasts[i]), last) == 0)
+					break;
+			}
+			if (i == server.numEmp)
+				i = -1;
+		}
+		if (i == -1)
+			res->status = RES_NOTFOUND;
+		else {
+			char *firstName = nameAt(server.db, server.db->firsts[i]);
+			char *lastName = nameAt(server.db, server.db->lasts[i]);
+			res->id = server.db->ids[i];
+			res->salary = server.db->salaries[i];
+			res->firstLen = strlen(firstName);
+			res->lastLen = strlen(lastName);
+			memcpy(outNames, firstName, res->firstLen);
+			memcpy(outNames + res->firstLen, lastName, res->lastLen);
+		}
+		pthread_rwlock_unlock(&server.lock);
+		return;
+	}
+
+	int newId = req->op == REQ_ADD ? req->id : req->newId;
+	if ((req->op != REQ_ADD && req->op != REQ_UPDATE)
+			|| !validEmployee(newId, first, last, req->salary)) {
+		res->status = RES_INVALID;
+		return;
+	}
+	Employee emp;
+	makeEmployee(&emp, newId, first, last, req->salary);
+
+	pthread_rwlock_wrlock(&server.lock);
+	if (req->op == REQ_ADD) {
+		if (findById(server.db, newId, server.numEmp) != -1)
+			res->status = RES_EXISTS;
+		else {
+			server.numEmp = addSorted(server.db, server.numEmp, &emp);
+			walLog(WAL_ADD, 0, &emp);
+		}
+	}
+	else {
+		i = findById(server.db, req->id, server.numEmp);
+		if (i == -1)
+			res->status = RES_NOTFOUND;
+		else if (newId != req->id && findById(server.db, newId, server.numEmp) != -1)
+			res->status = RES_EXISTS;
+		else {
+			server.numEmp = updateAt(server.db, server.numEmp, i, &emp);
+			walLog(WAL_UPDATE, req->id, &emp);
+		}
+	}
+	if (store.policy == FSYNC_ALWAYS)
+		walCommit();
+	pthread_rwlock_unlock(&server.lock);
+}
+
+/* Connects to the server's socket.
+ *
+ * @return the connected socket, or -1 on error
+ */
+int connectTo(char *sockPath) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, sockPath, sizeof(addr.sun_path) - 1);
+	if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Comparison function for qsort, orders doubles ascending.
+ */
+int compareDoubles(const void *a, const void *b) {
+	double d1 = *(const double *)a, d2 = *(const double *)b;
+	return (d1 > d2) - (d1 < d2);
+}
+
+/* Drives a server with numClients concurrent connections and prints the
+ * throughput and latency percentiles of numRequests requests.
+ *
+ * @param sockPath The server's socket
+ * @param db Employees whose IDs the requests use
+ * @param numEmp The number of employees in db
+ * @param numRequests Total requests across all clients
+ * @param numClients Number of client threads
+ * @param writePct Percent of requests that are updates instead of lookups
+ */
+void runLoadGen(char *sockPath, EmployeeTable *db, int numEmp, long numRequests,
+		int numClients, int writePct) {
+	if (numEmp == 0 || numClients < 1) {
+		printf("Error: load generator needs employees and at least one client\n");
+		exit(1);
+	}
+	pthread_t *tid_arr = malloc(numClients * sizeof(pthread_t));
+	ClientArgs *client_args = calloc(numClients, sizeof(ClientArgs));
+	double *latencies = malloc(numRequests * sizeof(double));
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	long offset = 0;
+	for (int i = 0; i < numClients; i++) {
+		client_args[i].sockPath = sockPath;
+		client_args[i].db = db;
+		client_args[i].numEmp = numEmp;
+		client_args[i].numRequests = numRequests / numClients
+			+ (i < numRequests % numClients ? 1 : 0);
+		client_args[i].writePct = writePct;
+		client_args[i].seed = i + 1;
+		client_args[i].latencies = latencies + offset;
+		offset += client_args[i].numRequests;
+		pthread_create(&tid_arr[i], NULL, clientFunc, (void *)&client_args[i]);
+	}
+	long errors = 0;
+	for (int i = 0; i < numClients; i++) {
+		pthread_join(tid_arr[i], NULL);
+		errors += client_args[i].errors;
+	}
+	double secs = elapsedSeconds(&start);
+
+	qsort(latencies, numRequests, sizeof(double), compareDoubles);
+	double pcts[] = {50, 90, 99, 99.9};
+	printf("%ld requests, %d clients, %d%% writes: %.3f s (%.0f requests/sec), %ld errors\n",
+			numRequests, numClients, writePct, secs, numRequests / secs, errors);
+	for (int i = 0; i < 4; i++) {
+		long k = (long)(pcts[i] / 100 * (numRequests - 1));
+		printf("p%-5g %8.1f us\n", pcts[i], latencies[k] * 1e6);
+	}
+	printf("max    %8.1f us\n", latencies[numRequests - 1] * 1e6);
+	free(latencies);
+	free(client_args);
+	free(tid_arr);
+}
+
+/* Load generator thread: sends its share of requests one at a time over its
+ * own connection, timing each round trip.
+ *
+ * @param arg This thread's ClientArgs
+ */
+void *clientFunc(void *arg) {
+	ClientArgs *args = (ClientArgs *)arg;
+	int fd = connectTo(args->sockPath);
+	if (fd == -1) {
+		printf("Error: cannot connect to %s\n", args->sockPath);
+		exit(1);
+	}
+	char names[2 * MAXNAME];
+	for (long i = 0; i < args->numRequests; i++) {
+		int row = rand_r(&args->seed) % args->numEmp;
+		Request req;
+		Response res;
+		memset(&req, 0, sizeof(req));
+		req.id = args->db->ids[row];
+		if ((int)(rand_r(&args->seed) % 100) < args->writePct) {
+			// Update in place with a new salary so the ID stays valid
+			char *first = nameAt(args->db, args->db->firsts[row]);
+			char *last = nameAt(args->db, args->db->lasts[row]);
+			req.op = REQ_UPDATE;
+			req.newId = req.id;
+			req.salary = 30000 + rand_r(&args->seed) % 120001;
+			req.firstLen = strlen(first);
+			req.lastLen = strlen(last);
+			memcpy(names, first, req.firstLen);
+			memcpy(names + req.firstLen, last, req.lastLen);
+		}
+		else
+			req.op = REQ_ID;
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (writeAll(fd, &req, sizeof(req)) == -1
+				|| writeAll(fd, names, req.firstLen + req.lastLen) == -1
+				|| readAll(fd, &res, sizeof(res)) == -1
+				|| readAll(fd, names, res.firstLen + res.lastLen) == -1) {
+			printf("Error: lost connection to server\n");
+			exit(1);
+		}
+		args->latencies[i] = elapsedSeconds(&start);
+		if (res.status != RES_OK)
+			args->errors++;
+	}
+	close(fd);
+	return NULL;
+}
+
 /*  DO NOT MODIFY THIS FUNCTION. It works "as is".
  *
  *  This function gets the filename passed in as a command line option
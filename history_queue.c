@@ -5,64 +5,393 @@
  *
  * Names: Tyler Bullock & Zach Fukuhara
  *
- * Description: Program that implements a circular queue of history items
+ * Description: Program that keeps the shell's command history.  Every command
+ * is appended to a history file ($TTSH_HISTFILE, or ~/.ttsh_history) so the
+ * history outlives the shell.  At startup the file is mmap'd and split into
+ * lines once, giving an array from command number to command, so '!num' is a
+ * single array lookup no matter how long the history is.  Searches
+ * ('history -s pattern' and '!prefix') go through a trigram index, built the
+ * first time one is needed, that narrows the history down to the commands
+ * containing every three-character piece of the pattern before any text is
+ * compared.
+ *
+ * Another shell can truncate the history file while this one has it
+ * mapped, and touching a mapped page past the end of the file raises
+ * SIGBUS, so the file's size is checked with fstat before the mapped
+ * commands are read.
  */
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "history_queue.h"
 
-static HistoryEntry history[MAXHIST];
-static int start = 0;
-static int next = 0;
-static int size = 0;
+// One command: its text is in the mapped file for commands from earlier
+// sessions and malloc'd for ones added since
+struct HistoryLine {
+	const char *text;
+	int len;
+};
+typedef struct HistoryLine HistoryLine;
+
+// The commands containing one trigram, in increasing command number order
+struct Posting {
+	unsigned int key;      // the three bytes, plus 1 << 24 so 0 means empty
+	unsigned int *nums;
+	int count;
+	int capacity;
+};
+typedef struct Posting Posting;
+
+static HistoryLine *lines = NULL;    // lines[n - 1] is command n
+static unsigned int size = 0;
+static unsigned int capacity = 0;
+static int hist_fd = -1;
+static const char *map = NULL;       // the history file as of history_init
+static size_t map_len = 0;
+static unsigned int map_lines = 0;   // commands 1 to map_lines are in map
+
+static Posting *trigrams = NULL;     // open addressing, NULL until needed
+static unsigned int num_slots = 0;   // power of two
+static unsigned int num_trigrams = 0;
+
+static char found[MAXLINE];          // returned by find_cmd and find_prefix
 
-/* Adds a HistoryEntry struct to the history queue
+unsigned int history_init();
+void add_entry(HistoryEntry val);
+void print_history();
+char *find_cmd(unsigned int hist_id);
+char *find_prefix(const char *prefix);
+void search_history(const char *pattern);
+static void append_line(const char *text, int len);
+static void check_map();
+static void build_index();
+static void index_line(unsigned int num);
+static Posting *find_posting(unsigned int key, int add);
+static int candidates(const char *pattern, int len, unsigned int **nums);
+static int has_num(Posting *posting, unsigned int num);
+static int contains(const HistoryLine *line, const char *pattern, int len);
+static char *copy_line(unsigned int num);
+
+/* Opens (creating if needed) the history file and loads its commands.
  *
- * @param val HistoryEntry struct to be added to the queue
+ * @return number to give the next command
  */
-void add_entry(HistoryEntry val){
-	if (next < MAXHIST) {
-		history[next] = val;
-		next++;
-		size++;
-	}
-	else {
-		history[start] = val;
-		if (start < MAXHIST - 1) {
-			start++;
-		}
-		else {
-			start = 0;
-		}
+unsigned int history_init() {
+	char path[MAXLINE];
+	struct stat st;
+
+	if (getenv("TTSH_HISTFILE") != NULL)
+		snprintf(path, sizeof(path), "%s", getenv("TTSH_HISTFILE"));
+	else
+		snprintf(path, sizeof(path), "%s/.ttsh_history", getenv("HOME") ? getenv("HOME") : ".");
+	hist_fd = open(path, O_RDWR | O_APPEND | O_CREAT, 0600);
+	if (hist_fd == -1) {
+		printf("Warning: cannot open %s, history will not be saved\n", path);
+		return 1;
 	}
+	fcntl(hist_fd, F_SETFD, FD_CLOEXEC);
+	if (fstat(hist_fd, &st) == -1 || st.st_size == 0)
+		return 1;
+
+	// The mapping stays for the life of the shell: lines point into it
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, hist_fd, 0);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		return 1;
+	}
+	map_len = st.st_size;
+	const char *p = map, *end = map + st.st_size;
+	while (p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+		if (eol == NULL)
+			eol = end;
+		append_line(p, eol - p);
+		p = eol + 1;
+	}
+	map_lines = size;
+	return size + 1;
+}
+
+/* Adds a command to the history and appends it to the history file.
+ *
+ * @param val HistoryEntry struct to be added (its cmd_num should be the
+ * 		number history_init or the previous add_entry handed out)
+ */
+void add_entry(HistoryEntry val){
+	int len = strcspn(val.cmdline, "\n");
+	char *text = malloc(len + 1);
+	memcpy(text, val.cmdline, len);
+	text[len] = '\n';
+	if (hist_fd != -1 && write(hist_fd, text, len + 1) != len + 1)
+		printf("Warning: could not save command to history\n");
+	append_line(text, len);
+	if (trigrams != NULL)
+		index_line(size);
 }
 
-/* Prints the history log
+/* Prints the MAXHIST most recent commands
  */
 void print_history() {
-	int index = start;
-	for (int i = 0; i < size; i++) {
-		if (index >= size) {
-			index = 0;
-		}
-		printf("%d\t%s", history[index].cmd_num , history[index].cmdline);
-		index++;
+	check_map();
+	unsigned int first = size > MAXHIST ? size - MAXHIST + 1 : 1;
+	for (unsigned int num = first; num <= size; num++) {
+		printf("%u\t%.*s\n", num, lines[num - 1].len, lines[num - 1].text);
 	}
 }
 
 /* Finds the command that corresponds to hist_id
  *
- * @param hist_id ID corresponding a command in the history queue
- * @return returns the command from the history or NULL if the command cannot
- * 		be found in the history
+ * @param hist_id ID corresponding a command in the history
+ * @return returns the command (newline terminated, like a line from fgets)
+ * 		or NULL if the command cannot be found in the history
  */
 char *find_cmd(unsigned int hist_id){
-	for (int i = 0; i < size; i++) {
-		if (history[i].cmd_num == hist_id) {
-			return history[i].cmdline;
+	if (hist_id < 1 || hist_id > size)
+		return NULL;
+	check_map();
+	return copy_line(hist_id);
+}
+
+/* Finds the most recent command that starts with prefix.
+ *
+ * @param prefix start of the command to look for
+ * @return the command (newline terminated) or NULL if there is none
+ */
+char *find_prefix(const char *prefix) {
+	int len = strlen(prefix);
+	unsigned int *nums;
+	check_map();
+	int count = candidates(prefix, len, &nums);
+
+	for (int i = count - 1; i >= 0; i--) {
+		unsigned int num = nums == NULL ? (unsigned int)i + 1 : nums[i];
+		if (lines[num - 1].len >= len && memcmp(lines[num - 1].text, prefix, len) == 0) {
+			free(nums);
+			return copy_line(num);
 		}
 	}
+	free(nums);
 	return NULL;
 }
+
+/* Prints every command that contains pattern, oldest first.
+ *
+ * @param pattern text to look for
+ */
+void search_history(const char *pattern) {
+	int len = strlen(pattern);
+	unsigned int *nums;
+	check_map();
+	int count = candidates(pattern, len, &nums);
+
+	for (int i = 0; i < count; i++) {
+		unsigned int num = nums == NULL ? (unsigned int)i + 1 : nums[i];
+		if (contains(&lines[num - 1], pattern, len))
+			printf("%u\t%.*s\n", num, lines[num - 1].len, lines[num - 1].text);
+	}
+	free(nums);
+}
+
+/* Adds a command to the end of the in-memory history.
+ *
+ * @param text command text (not NUL terminated), which must outlive the shell
+ * @param len length of the command
+ */
+static void append_line(const char *text, int len) {
+	if (size == capacity) {
+		capacity = capacity == 0 ? 1024 : capacity * 2;
+		lines = realloc(lines, capacity * sizeof(HistoryLine));
+	}
+	lines[size].text = text;
+	lines[size].len = len;
+	size++;
+}
+
+/* Makes sure the mapped commands can still be read.  If the history file
+ * has shrunk since history_init, the commands that are still inside it are
+ * copied out, the ones that were cut off are kept as empty commands (so
+ * command numbers don't change), and the mapping is dropped.
+ */
+static void check_map() {
+	struct stat st;
+	if (map == NULL)
+		return;
+	size_t kept = fstat(hist_fd, &st) == 0 ? (size_t)st.st_size : 0;
+	if (kept >= map_len)
+		return;
+	for (unsigned int num = 1; num <= map_lines; num++) {
+		HistoryLine *line = &lines[num - 1];
+		if ((size_t)(line->text - map) + line->len > kept) {
+			line->text = "";
+			line->len = 0;
+			continue;
+		}
+		char *text = malloc(line->len + 1);
+		memcpy(text, line->text, line->len);
+		line->text = text;
+	}
+	munmap((void *)map, map_len);
+	map = NULL;
+}
+
+/* Builds the trigram index over the whole history.
+ */
+static void build_index() {
+	num_slots = 4096;
+	trigrams = calloc(num_slots, sizeof(Posting));
+	for (unsigned int num = 1; num <= size; num++) {
+		index_line(num);
+	}
+}
+
+/* Adds a command to the posting list of every trigram it contains.
+ *
+ * @param num number of the command
+ */
+static void index_line(unsigned int num) {
+	const unsigned char *text = (const unsigned char *)lines[num - 1].text;
+	for (int i = 0; i + 3 <= lines[num - 1].len; i++) {
+		unsigned int key = (text[i] << 16 | text[i + 1] << 8 | text[i + 2]) | 1 << 24;
+		Posting *posting = find_posting(key, 1);
+		// Commands are indexed in order, so a repeat trigram is always last
+		if (posting->count > 0 && posting->nums[posting->count - 1] == num)
+			continue;
+		if (posting->count == posting->capacity) {
+			posting->capacity = posting->capacity == 0 ? 4 : posting->capacity * 2;
+			posting->nums = realloc(posting->nums, posting->capacity * sizeof(unsigned int));
+		}
+		posting->nums[posting->count++] = num;
+	}
+}
+
+/* Looks up the posting list for a trigram, probing linearly from a
+ * multiplicative hash of it.  The table doubles when it gets half full.
+ *
+ * @param key the trigram's key
+ * @param add 1 to add an empty list if the trigram isn't there yet
+ * @return the posting list, or NULL if it isn't there and add is 0
+ */
+static Posting *find_posting(unsigned int key, int add) {
+	unsigned int mask = num_slots - 1;
+	unsigned int slot = (key * 2654435761u) >> 7 & mask;
+	while (trigrams[slot].key != 0) {
+		if (trigrams[slot].key == key)
+			return &trigrams[slot];
+		slot = (slot + 1) & mask;
+	}
+	if (!add)
+		return NULL;
+
+	if ((num_trigrams + 1) * 2 > num_slots) {
+		Posting *old = trigrams;
+		unsigned int old_slots = num_slots;
+		num_slots *= 2;
+		trigrams = calloc(num_slots, sizeof(Posting));
+		mask = num_slots - 1;
+		for (unsigned int i = 0; i < old_slots; i++) {
+			if (old[i].key == 0)
+				continue;
+			slot = (old[i].key * 2654435761u) >> 7 & mask;
+			while (trigrams[slot].key != 0)
+				slot = (slot + 1) & mask;
+			trigrams[slot] = old[i];
+		}
+		free(old);
+		slot = (key * 2654435761u) >> 7 & mask;
+		while (trigrams[slot].key != 0)
+			slot = (slot + 1) & mask;
+	}
+	trigrams[slot].key = key;
+	num_trigrams++;
+	return &trigrams[slot];
+}
+
+/* Finds the commands that could contain pattern: those on the posting list of
+ * every trigram in it.  They still have to be checked, since the trigrams
+ * may be in a different order.  Patterns shorter than a trigram match
+ * anything.
+ *
+ * @param pattern text being searched for
+ * @param len length of pattern
+ * @param nums set to a malloc'd array of candidate command numbers in
+ * 		increasing order, or NULL if every command is a candidate
+ * @return number of candidates
+ */
+static int candidates(const char *pattern, int len, unsigned int **nums) {
+	*nums = NULL;
+	if (len < 3)
+		return size;
+	if (trigrams == NULL)
+		build_index();
+
+	// Start from the shortest list and check each entry against the rest
+	const unsigned char *p = (const unsigned char *)pattern;
+	Posting *shortest = NULL;
+	for (int i = 0; i + 3 <= len; i++) {
+		Posting *posting = find_posting((p[i] << 16 | p[i + 1] << 8 | p[i + 2]) | 1 << 24, 0);
+		if (posting == NULL) {
+			*nums = malloc(sizeof(unsigned int));
+			return 0;
+		}
+		if (shortest == NULL || posting->count < shortest->count)
+			shortest = posting;
+	}
+	*nums = malloc(shortest->count * sizeof(unsigned int));
+	int count = 0;
+	for (int j = 0; j < shortest->count; j++) {
+		int everywhere = 1;
+		for (int i = 0; i + 3 <= len && everywhere; i++) {
+			Posting *posting = find_posting((p[i] << 16 | p[i + 1] << 8 | p[i + 2]) | 1 << 24, 0);
+			everywhere = posting == shortest || has_num(posting, shortest->nums[j]);
+		}
+		if (everywhere)
+			(*nums)[count++] = shortest->nums[j];
+	}
+	return count;
+}
+
+/* Binary searches a posting list for a command number.
+ */
+static int has_num(Posting *posting, unsigned int num) {
+	int lo = 0, hi = posting->count - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (posting->nums[mid] == num)
+			return 1;
+		else if (posting->nums[mid] < num)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return 0;
+}
+
+/* Returns 1 if a command contains pattern anywhere.
+ */
+static int contains(const HistoryLine *line, const char *pattern, int len) {
+	if (len == 0)
+		return 1;
+	const char *p = line->text, *end = line->text + line->len - len + 1;
+	while (p < end && (p = memchr(p, pattern[0], end - p)) != NULL) {
+		if (memcmp(p, pattern, len) == 0)
+			return 1;
+		p++;
+	}
+	return 0;
+}
+
+/* Copies a command into the found buffer with a newline, ready to be parsed
+ * like a line read by the shell.
+ */
+static char *copy_line(unsigned int num) {
+	int len = lines[num - 1].len < MAXLINE - 2 ? lines[num - 1].len : MAXLINE - 2;
+	memcpy(found, lines[num - 1].text, len);
+	found[len] = '\n';
+	found[len + 1] = '\0';
+	return found;
+}
@@ -4,8 +4,32 @@
  * This file contains code that takes in a data file command line argument
  * from the user and computes the mean, median, and standard deviation.
  * The program then prints these statistics, along with the number of values
- * in the user input data and the unused capacity in the array that stores the values
- * ([] is called data).
+ * in the user input data and, with -r, the unused capacity in the array that
+ * stores the values ([] is called data).
+ *
+ * With the -s option the values are streamed instead of stored: count, mean
+ * and standard deviation are computed in a single pass (Kahan summation for
+ * the mean, Welford updates for the variance) and the median and any other
+ * percentiles (-p 90,99,...) come from a KLL quantile sketch whose rank
+ * error is bounded by -e (default 0.01), so memory use stays bounded no
+ * matter how large the input is.
+ *
+ * Without -s the values are loaded and the exact median and percentiles are
+ * found with introselect (no full sort), while the mean and standard
+ * deviation are computed by -t threads (default 4) using vectorized,
+ * compensated sums.  '-B n' benchmarks these against the original
+ * functions on n random values.
+ *
+ * Text input is mmap'd and split into -t chunks that are parsed in parallel
+ * with a fast float parser (falling back to strtod only for values it
+ * cannot convert exactly); with -s each chunk keeps its own statistics and
+ * sketch, merged at the end.  -b reads the file as raw little-endian doubles
+ * instead, with no parsing at all, and -r uses the original readfile.h
+ * reader.
+ *
+ * -c and -g switch to table mode for CSV/TSV files: statistics and a
+ * histogram (-n bins) for every selected column (-c names or numbers) of
+ * every group (-g column), all in one pass.
  *
  * This file is part of COMP 280, Lab #3.
  *
@@ -16,38 +40,285 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "readfile.h"
 #include <valgrind/memcheck.h>
 
+#define MAXPCTS 32
+#define SMALLSELECT 16      // ranges this small are finished by insertion sort
+#define BUBBLELIMIT 100000  // largest benchmark size the bubble sort median gets
+#define MAXCOLS 64          // most columns table mode can summarize at once
+#define MAXFIELDS 1024      // fields per line looked at in table mode
+
+// Four doubles handled together; GCC maps the arithmetic onto whatever SIMD
+// registers the target has (two SSE2 ops, or one AVX op with -mavx)
+typedef double vec4 __attribute__ ((vector_size (32)));
+
+// Per-thread arguments for the chunked reductions
+struct ThreadArgs {
+	double *data;
+	long start;
+	long end;
+	double mean;    // subtracted before squaring (0 for a plain sum)
+	int squares;    // 1 to sum (x - mean)^2, 0 to sum x
+	double sum;     // result
+	double comp;    // leftover compensation for the result
+};
+typedef struct ThreadArgs ThreadArgs;
+
+// Per-thread arguments for parsing one chunk of a mapped text file
+struct ParseArgs {
+	const char *start;
+	const char *end;
+	double *values;     // parsed values, grown as needed
+	long count;
+	long capacity;
+	const char *error;  // first token that is not a number, or NULL
+};
+typedef struct ParseArgs ParseArgs;
+
+// One level of a KLL sketch.  Every item at level h stands for 2^h input
+// values.
+struct Compactor {
+	double *items;
+	int n;
+	int capacity;
+	int limit;      // items it may hold before it is compacted
+};
+typedef struct Compactor Compactor;
+
+// KLL quantile sketch: a stack of compactors whose capacities shrink by 2/3
+// per level going down from the top, so the sketch holds O(k log(n/k))
+// items for n values and answers rank queries to within about 1/k of n.
+struct KllSketch {
+	Compactor *levels;
+	int numLevels;
+	int k;
+	long count;
+	unsigned int seed;
+};
+typedef struct KllSketch KllSketch;
+
+// A sketch item with the number of input values it stands for.  The value
+// comes first so compareDoubles can sort these directly.
+struct WeightedItem {
+	double value;
+	long weight;
+};
+typedef struct WeightedItem WeightedItem;
+
+// Single pass running statistics
+struct RunningStats {
+	long count;
+	double sum, comp;   // Kahan sum and its running compensation
+	double mean, m2;    // Welford mean and sum of squared deviations
+	double min, max;
+	KllSketch sketch;
+};
+typedef struct RunningStats RunningStats;
+
+// Per-thread arguments for streaming one chunk of a mapped text file
+struct StreamArgs {
+	const char *start;
+	const char *end;
+	RunningStats stats;
+	const char *error;  // first token that is not a number, or NULL
+};
+typedef struct StreamArgs StreamArgs;
+
+// One field of a CSV/TSV line, pointing into the mapped file
+struct Field {
+	const char *start;
+	int len;
+};
+typedef struct Field Field;
+
+// Accumulators for every selected column of one group
+struct Group {
+	char *key;
+	int keyLen;
+	long rows;
+	RunningStats *columns;
+};
+typedef struct Group Group;
+
+// Open addressing hash table from group key to Group
+struct GroupTable {
+	Group *groups;      // in order of first appearance
+	int count;
+	int capacity;
+	int *slots;         // index into groups, or -1 if empty
+	int numSlots;       // power of two
+	int numColumns;
+	double eps;
+};
+typedef struct GroupTable GroupTable;
+
 // Forward Declaration
 double *getValues(int *size, int *capacity, char *filename);
 double getMean(int size, double *data);
 double getMedian(int size, double *data);
 double getStandardDev(int size, double *data, double mean);
+void usage(char *executable_name);
+int parsePercentiles(char *list, double *pcts);
+void streamStats(char *filename, double eps, double *pcts, int numPcts, int binary, int numThreads);
+void *streamThread(void *stream_args);
+void statsInit(RunningStats *stats, double eps);
+void statsAdd(RunningStats *stats, double value);
+void statsMerge(RunningStats *into, RunningStats *from);
+void kllInit(KllSketch *sketch, int k);
+void kllAdd(KllSketch *sketch, double value);
+void kllCompress(KllSketch *sketch);
+void kllSetLimits(KllSketch *sketch);
+void kllMerge(KllSketch *into, KllSketch *from);
+double kllQuantile(KllSketch *sketch, double q);
+int kllRetained(KllSketch *sketch);
+void kllFree(KllSketch *sketch);
+int compareDoubles(const void *a, const void *b);
+double selectKth(double *data, long n, long k);
+double getPercentile(long size, double *data, double pct);
+double getMedianFast(long size, double *data);
+double getMeanFast(long size, double *data, int numThreads);
+double getStandardDevFast(long size, double *data, double mean, int numThreads);
+double parallelSum(double *data, long size, double mean, int squares, int numThreads);
+void *sumThread(void *thread_args);
+void runBenchmark(long n, int numThreads);
+double seconds(struct timespec *start);
+char *mapFile(char *filename, size_t *length, int writable);
+double *mapValues(char *filename, long *size, int numThreads);
+double *mapBinary(char *filename, long *size);
+void *parseThread(void *parse_args);
+const char *chunkEnd(const char *text, size_t length, const char *start, int i, int numThreads);
+const char *parseDouble(const char *p, const char *end, double *value);
+void invalidValue(const char *bad, const char *text, const char *end);
+void tableStats(char *filename, char *columnSpec, char *groupSpec, char delim,
+		int bins, double eps, double *pcts, int numPcts);
+int splitFields(const char *p, const char *end, char delim, Field *fields, int maxFields);
+int specHasNames(char *spec);
+int findColumn(char *spec, Field *header, int numHeader, int hasHeader);
+void groupsInit(GroupTable *table, int numColumns, double eps);
+Group *findGroup(GroupTable *table, const char *key, int keyLen);
+void groupsFree(GroupTable *table);
+unsigned int hashKey(const char *key, int len);
+int compareGroups(const void *a, const void *b);
+void printHistogram(char *name, RunningStats *stats, int bins);
+void kllHistogram(KllSketch *sketch, double lo, double hi, long *counts, int bins);
+
+void usage(char *executable_name) {
+	printf("usage: %s [-s [-e error]] [-b | -r] [-t threads] [-p pct,pct,...] filename\n"
+			"       %s -c col,col,... [-g col] [-F delim] [-n bins] [-e error] [-p pct,...] file.csv\n"
+			"       %s -B num_values [-t threads]\n", executable_name, executable_name, executable_name);
+}
 
 // Begin main function
 int main(int argc, char *argv[]) {
-	if(argc != 2) {
-		printf ("usage: ./stats filename\n");
+	int streaming = 0, numPcts = 0, numThreads = 4, binary = 0, readfile = 0;
+	long benchSize = 0;
+	double eps = 0.01, pcts[MAXPCTS];
+	char *columnSpec = NULL, *groupSpec = NULL, delim = 0;
+	int bins = 10;
+	int c;
+	while ((c = getopt(argc, argv, "se:p:t:B:brc:g:F:n:")) != -1) {
+		switch(c) {
+			case 'c':
+				columnSpec = optarg;
+				break;
+			case 'g':
+				groupSpec = optarg;
+				break;
+			case 'F':
+				delim = strcmp(optarg, "\\t") == 0 ? '\t' : optarg[0];
+				break;
+			case 'n':
+				bins = strtol(optarg, NULL, 10);
+				break;
+			case 'b':
+				binary = 1;
+				break;
+			case 'r':
+				readfile = 1;
+				break;
+			case 't':
+				numThreads = strtol(optarg, NULL, 10);
+				break;
+			case 'B':
+				benchSize = strtol(optarg, NULL, 10);
+				break;
+			case 's':
+				streaming = 1;
+				break;
+			case 'e':
+				eps = strtod(optarg, NULL);
+				break;
+			case 'p':
+				numPcts = parsePercentiles(optarg, pcts);
+				break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+	if(numThreads < 1)
+		numThreads = 1;
+	if(benchSize > 0) {
+		runBenchmark(benchSize, numThreads);
+		return 0;
+	}
+	if(argc - optind != 1 || eps <= 0 || eps >= 1 || (binary && readfile)) {
+		usage(argv[0]);
 		exit(1);
 	}
-	// argv[1] contains filename string (pass argv[1] as the
-	// third argument to getValues)
-	int size = 0, capacity = 20;
-	int *s = &size;
-	int *c = &capacity;
-	double *arr = getValues(s, c, argv[1]);
-	double mean = getMean(size, arr);
-	double std = getStandardDev(size, arr, mean);
-	double median = getMedian(size, arr);
-	int unused = capacity - size;
+	if(columnSpec != NULL || groupSpec != NULL) {
+		tableStats(argv[optind], columnSpec, groupSpec, delim, bins, eps, pcts, numPcts);
+		return 0;
+	}
+	if(streaming) {
+		streamStats(argv[optind], eps, pcts, numPcts, binary, numThreads);
+		return 0;
+	}
+	long size = 0, unused = 0;
+	double *arr;
+	if(binary) {
+		arr = mapBinary(argv[optind], &size);
+	}
+	else if(readfile) {
+		// argv[optind] contains filename string (pass it as the
+		// third argument to getValues)
+		int n = 0, cap = 20;
+		arr = getValues(&n, &cap, argv[optind]);
+		size = n;
+		unused = cap - n;
+	}
+	else {
+		arr = mapValues(argv[optind], &size, numThreads);
+	}
+	double mean = getMeanFast(size, arr, numThreads);
+	double std = getStandardDevFast(size, arr, mean, numThreads);
+	double median = getMedianFast(size, arr);
 	printf("\nStatistics:\n--------\n");
-	printf("num values:\t\t%d\n", size);
+	printf("num values:\t\t%ld\n", size);
 	printf("mean:\t\t\t%.3f\n", mean);
 	printf("median:\t\t\t%.3f\n", median);
 	printf("std dev:\t\t%.3f\n", std);
-	printf("\nUnused array slots:\t%d\n\n", unused);
-	free(arr);
+	for(int i = 0; i < numPcts; i++){
+		printf("p%g:\t\t\t%.3f\n", pcts[i], getPercentile(size, arr, pcts[i]));
+	}
+	// Only getValues grows an array with room to spare; the other readers
+	// size theirs exactly
+	if(readfile)
+		printf("\nUnused array slots:\t%ld\n", unused);
+	printf("\n");
+	if(binary)
+		munmap(arr, size * sizeof(double));
+	else
+		free(arr);
 	return 0;
 }
 
@@ -82,12 +353,12 @@ double *getValues(int *size, int *capacity, char *filename) {
 		// If array runs out of space, double capacity
 	    if(i > *capacity - 1){
 			*capacity *= 2;
-			// Create new array and copy over values
-	    	double *more_data = malloc(*capacity * sizeof(double));
-			for(int j = 0; j < i; j++){
-				more_data[j] = data[j];
+			// realloc can usually grow in place instead of copying
+	    	double *more_data = realloc(data, *capacity * sizeof(double));
+			if(more_data == NULL){
+				printf("Out of memory after %d values\n", i);
+				exit(1);
 			}
-			free(data); // Free space allocated for data
 			data = more_data;
 		}
 	}
@@ -167,3 +438,1385 @@ double getStandardDev(int size, double *data, double mean){
     double result = stdv / (size - 1);
     return sqrt(result);
 }
+
+/*
+ * Parses a comma separated list of percentiles (0 to 100).
+ *
+ * @param list List from the command line, e.g. "90,99,99.9"
+ * @param pcts Array of at least MAXPCTS to fill in
+ *
+ * @return number of percentiles parsed
+ */
+int parsePercentiles(char *list, double *pcts){
+	int n = 0;
+	char *end = list;
+	while(*end != '\0' && n < MAXPCTS){
+		double p = strtod(list, &end);
+		if(end == list || p < 0 || p > 100){
+			printf("Invalid percentile list: %s\n", list);
+			exit(1);
+		}
+		pcts[n++] = p;
+		if(*end == ',')
+			end++;
+		list = end;
+	}
+	return n;
+}
+
+/*
+ * Streaming mode: reads every value in filename once, without storing them,
+ * and prints the count, mean, standard deviation, min and max along with an
+ * approximate median and any requested percentiles.
+ *
+ * @param filename Name of the file containing the values
+ * @param eps Rank error bound for the median and percentiles
+ * @param pcts Extra percentiles to print
+ * @param numPcts Number of extra percentiles
+ * @param binary 1 if the file holds raw little-endian doubles
+ * @param numThreads Threads to parse a text file with
+ */
+void streamStats(char *filename, double eps, double *pcts, int numPcts, int binary, int numThreads){
+	RunningStats stats;
+	statsInit(&stats, eps);
+	if(binary) {
+		// Only read front to back, so the mapping stays clean file pages
+		// the kernel can drop again under memory pressure
+		long size;
+		double *values = mapBinary(filename, &size);
+		for(long i = 0; i < size; i++){
+			statsAdd(&stats, values[i]);
+		}
+		munmap(values, size * sizeof(double));
+	}
+	else {
+		// Parsed straight from the mapping with the same parser as the
+		// default path, so a bad value fails the same way instead of
+		// looking like the end of the file.  Each thread keeps its own
+		// statistics and sketch, merged once they are done.
+		size_t length;
+		const char *text = mapFile(filename, &length, 0), *end = text + length, *start = text;
+		if(numThreads > (long)(length / 65536) + 1)
+			numThreads = length / 65536 + 1;
+		pthread_t *tid_arr = malloc(numThreads * sizeof(pthread_t));
+		StreamArgs *stream_args = calloc(numThreads, sizeof(StreamArgs));
+		for(int i = 0; i < numThreads; i++){
+			stream_args[i].start = start;
+			stream_args[i].end = start = chunkEnd(text, length, start, i, numThreads);
+			statsInit(&stream_args[i].stats, eps);
+			stream_args[i].stats.sketch.seed = i + 1;
+			pthread_create(&tid_arr[i], NULL, streamThread, (void*)&stream_args[i]);
+		}
+		for(int i = 0; i < numThreads; i++){
+			pthread_join(tid_arr[i], NULL);
+		}
+		for(int i = 0; i < numThreads; i++){
+			if(stream_args[i].error != NULL)
+				invalidValue(stream_args[i].error, text, end);
+			statsMerge(&stats, &stream_args[i].stats);
+			kllFree(&stream_args[i].stats.sketch);
+		}
+		munmap((void *)text, length);
+		free(stream_args);
+		free(tid_arr);
+	}
+	if(stats.count == 0){
+		printf("The File is empty");
+		exit(1);
+	}
+
+	double std = stats.count > 1 ? sqrt(stats.m2 / (stats.count - 1)) : 0;
+	printf("\nStatistics:\n--------\n");
+	printf("num values:\t\t%ld\n", stats.count);
+	printf("mean:\t\t\t%.3f\n", stats.sum / stats.count);
+	printf("median:\t\t\t%.3f\n", kllQuantile(&stats.sketch, 0.5));
+	printf("std dev:\t\t%.3f\n", std);
+	printf("min:\t\t\t%.3f\n", stats.min);
+	printf("max:\t\t\t%.3f\n", stats.max);
+	for(int i = 0; i < numPcts; i++){
+		printf("p%g:\t\t\t%.3f\n", pcts[i], kllQuantile(&stats.sketch, pcts[i] / 100));
+	}
+	printf("\nSketch items retained:\t%d (k = %d, rank error <= %g)\n\n",
+			kllRetained(&stats.sketch), stats.sketch.k, eps);
+	kllFree(&stats.sketch);
+}
+
+/*
+ * Thread function for streamStats: parses the values in one chunk of a
+ * mapped text file into the thread's own running statistics, stopping at
+ * the first token that is not a number.
+ *
+ * @param stream_args Pointer to this thread's StreamArgs
+ */
+void *streamThread(void *stream_args){
+	StreamArgs *args = (StreamArgs*)stream_args;
+	const char *p = args->start, *end = args->end;
+	while(1){
+		while(p < end && isspace((unsigned char)*p))
+			p++;
+		if(p == end)
+			break;
+		double value;
+		const char *next = parseDouble(p, end, &value);
+		if(next == NULL){
+			args->error = p;
+			break;
+		}
+		statsAdd(&args->stats, value);
+		p = next;
+	}
+	return NULL;
+}
+
+/*
+ * Starts an empty set of running statistics.
+ *
+ * @param stats Statistics to initialize
+ * @param eps Rank error bound for the quantile sketch
+ */
+void statsInit(RunningStats *stats, double eps){
+	memset(stats, 0, sizeof(RunningStats));
+	stats->min = INFINITY;
+	stats->max = -INFINITY;
+	// KLL keeps the normalized rank error under about 4/k with high
+	// probability, so pick k to match eps
+	kllInit(&stats->sketch, (int)ceil(4 / eps));
+}
+
+/*
+ * Adds one value to the running statistics.
+ *
+ * @param stats Statistics to update
+ * @param value New value
+ */
+void statsAdd(RunningStats *stats, double value){
+	stats->count++;
+	// Kahan summation keeps the low order bits the plain sum would drop
+	double y = value - stats->comp;
+	double t = stats->sum + y;
+	stats->comp = (t - stats->sum) - y;
+	stats->sum = t;
+	// Welford's update for the variance avoids cancellation in sum(x^2)
+	double delta = value - stats->mean;
+	stats->mean += delta / stats->count;
+	stats->m2 += delta * (value - stats->mean);
+	if(value < stats->min)
+		stats->min = value;
+	if(value > stats->max)
+		stats->max = value;
+	kllAdd(&stats->sketch, value);
+}
+
+/*
+ * Adds one set of running statistics into another, as if every value added
+ * to 'from' had been added to 'into'.  The means and variances are combined
+ * with Chan et al.'s pairwise update.
+ *
+ * @param into Statistics to merge into
+ * @param from Statistics to merge from
+ */
+void statsMerge(RunningStats *into, RunningStats *from){
+	if(from->count == 0)
+		return;
+	long count = into->count + from->count;
+	double y = from->sum - from->comp - into->comp;
+	double t = into->sum + y;
+	into->comp = (t - into->sum) - y;
+	into->sum = t;
+	double delta = from->mean - into->mean;
+	into->mean += delta * from->count / count;
+	into->m2 += from->m2 + delta * delta * into->count * from->count / count;
+	into->count = count;
+	if(from->min < into->min)
+		into->min = from->min;
+	if(from->max > into->max)
+		into->max = from->max;
+	kllMerge(&into->sketch, &from->sketch);
+}
+
+/*
+ * Starts an empty KLL sketch.
+ *
+ * @param sketch Sketch to initialize
+ * @param k Capacity of the top level; larger k means smaller error
+ */
+void kllInit(KllSketch *sketch, int k){
+	sketch->k = k < 8 ? 8 : k;
+	sketch->count = 0;
+	sketch->seed = 1;
+	sketch->numLevels = 1;
+	sketch->levels = malloc(sizeof(Compactor));
+	sketch->levels[0].capacity = sketch->k;
+	sketch->levels[0].items = malloc(sketch->k * sizeof(double));
+	sketch->levels[0].n = 0;
+	kllSetLimits(sketch);
+}
+
+/*
+ * Sets the number of items each level may hold before it is compacted: k at
+ * the top level, shrinking by a factor of 2/3 per level below it.  Limits
+ * only change when a level is added, so they are worked out here rather
+ * than on every add.
+ */
+void kllSetLimits(KllSketch *sketch){
+	double limit = sketch->k;
+	for(int h = sketch->numLevels - 1; h >= 0; h--){
+		int cap = (int)ceil(limit);
+		sketch->levels[h].limit = cap < 2 ? 2 : cap;
+		limit *= 2.0 / 3.0;
+	}
+}
+
+/*
+ * Adds one value to the sketch, compacting when level 0 fills up.
+ */
+void kllAdd(KllSketch *sketch, double value){
+	Compactor *level0 = &sketch->levels[0];
+	if(level0->n == level0->capacity){
+		level0->capacity *= 2;
+		level0->items = realloc(level0->items, level0->capacity * sizeof(double));
+	}
+	level0->items[level0->n++] = value;
+	sketch->count++;
+	if(level0->n >= level0->limit)
+		kllCompress(sketch);
+}
+
+/*
+ * Compacts the lowest over-full level: its items are sorted and every other
+ * one (starting at a random offset) is promoted to the next level with
+ * double the weight, the rest are dropped.  Promotion can over-fill the next
+ * level, so this repeats up the stack, adding a new top level if needed.
+ */
+void kllCompress(KllSketch *sketch){
+	for(int h = 0; h < sketch->numLevels; h++){
+		Compactor *level = &sketch->levels[h];
+		if(level->n < level->limit)
+			continue;
+		if(h == sketch->numLevels - 1){
+			sketch->numLevels++;
+			sketch->levels = realloc(sketch->levels, sketch->numLevels * sizeof(Compactor));
+			level = &sketch->levels[h];
+			Compactor *top = &sketch->levels[h + 1];
+			top->capacity = sketch->k;
+			top->items = malloc(top->capacity * sizeof(double));
+			top->n = 0;
+			kllSetLimits(sketch);
+		}
+		Compactor *next = &sketch->levels[h + 1];
+		qsort(level->items, level->n, sizeof(double), compareDoubles);
+		// An odd item out stays behind so the total weight is preserved
+		int keep = level->n % 2;
+		int offset = rand_r(&sketch->seed) % 2;
+		int promoted = (level->n - keep) / 2;
+		if(next->n + promoted > next->capacity){
+			next->capacity = 2 * (next->n + promoted);
+			next->items = realloc(next->items, next->capacity * sizeof(double));
+		}
+		for(int i = keep + offset; i < level->n; i += 2){
+			next->items[next->n++] = level->items[i];
+		}
+		level->n = keep;
+	}
+}
+
+/*
+ * Adds the items of one sketch into another, as if every value added to
+ * 'from' had been added to 'into'.  Both must have the same k; 'from' is
+ * left unchanged.
+ *
+ * @param into Sketch to merge into
+ * @param from Sketch to merge from
+ */
+void kllMerge(KllSketch *into, KllSketch *from){
+	if(from->numLevels > into->numLevels){
+		into->levels = realloc(into->levels, from->numLevels * sizeof(Compactor));
+		for(int h = into->numLevels; h < from->numLevels; h++){
+			into->levels[h].capacity = into->k;
+			into->levels[h].items = malloc(into->k * sizeof(double));
+			into->levels[h].n = 0;
+		}
+		into->numLevels = from->numLevels;
+		kllSetLimits(into);
+	}
+	for(int h = 0; h < from->numLevels; h++){
+		Compactor *level = &into->levels[h], *other = &from->levels[h];
+		if(level->n + other->n > level->capacity){
+			level->capacity = 2 * (level->n + other->n);
+			level->items = realloc(level->items, level->capacity * sizeof(double));
+		}
+		memcpy(level->items + level->n, other->items, other->n * sizeof(double));
+		level->n += other->n;
+	}
+	into->count += from->count;
+	kllCompress(into);
+}
+
+/*
+ * Returns the approximate q-quantile of the values added to the sketch,
+ * interpolated between the neighbouring ranks the same way getPercentile
+ * does, so it is exact while nothing has been compacted.
+ *
+ * @param q Quantile from 0 to 1
+ */
+double kllQuantile(KllSketch *sketch, double q){
+	int n = 0;
+	WeightedItem *items = malloc(kllRetained(sketch) * sizeof(WeightedItem));
+	for(int h = 0; h < sketch->numLevels; h++){
+		for(int i = 0; i < sketch->levels[h].n; i++){
+			items[n].value = sketch->levels[h].items[i];
+			items[n].weight = 1L << h;
+			n++;
+		}
+	}
+	qsort(items, n, sizeof(WeightedItem), compareDoubles);
+	// Walk up the weighted ranks to the item standing for rank k; rank k + 1
+	// is the same item unless k is the last rank it stands for
+	double pos = q * (sketch->count - 1), result = 0;
+	long k = (long)pos, seen = 0;
+	for(int i = 0; i < n; i++){
+		seen += items[i].weight;
+		if(seen > k){
+			double lower = items[i].value;
+			double upper = seen > k + 1 || i == n - 1 ? lower : items[i + 1].value;
+			result = lower + (upper - lower) * (pos - k);
+			break;
+		}
+	}
+	free(items);
+	return result;
+}
+
+/*
+ * Returns the number of items the sketch is holding.
+ */
+int kllRetained(KllSketch *sketch){
+	int total = 0;
+	for(int h = 0; h < sketch->numLevels; h++){
+		total += sketch->levels[h].n;
+	}
+	return total;
+}
+
+/*
+ * Frees the sketch's levels.
+ */
+void kllFree(KllSketch *sketch){
+	for(int h = 0; h < sketch->numLevels; h++){
+		free(sketch->levels[h].items);
+	}
+	free(sketch->levels);
+}
+
+/*
+ * Comparison function for qsort, orders doubles ascending.
+ */
+int compareDoubles(const void *a, const void *b){
+	double d1 = *(const double *)a, d2 = *(const double *)b;
+	return (d1 > d2) - (d1 < d2);
+}
+
+/*
+ * Rearranges data so that data[k] holds the value it would have if the
+ * array were sorted, everything before it is <= and everything after it is
+ * >=, and returns that value.  This is introselect: quickselect with a
+ * median-of-three pivot, which is O(n) on average, falling back to sorting
+ * the remaining range if the partitions keep coming out lopsided, so the
+ * worst case is O(n log n) rather than O(n^2).
+ *
+ * @param data Array of data values (reordered)
+ * @param n Number of elements in array
+ * @param k Rank to select, from 0 to n - 1
+ *
+ * @return the k-th smallest value
+ */
+double selectKth(double *data, long n, long k){
+	long lo = 0, hi = n - 1;
+	int depth = 0;
+	for(long m = n; m > 1; m >>= 1){
+		depth += 2;
+	}
+	while(hi - lo > SMALLSELECT){
+		if(depth-- == 0){
+			qsort(data + lo, hi - lo + 1, sizeof(double), compareDoubles);
+			return data[k];
+		}
+		// Median of three pivot, moved out of the way to data[hi]
+		long mid = lo + (hi - lo) / 2;
+		if(data[mid] < data[lo]) { double t = data[mid]; data[mid] = data[lo]; data[lo] = t; }
+		if(data[hi] < data[lo]) { double t = data[hi]; data[hi] = data[lo]; data[lo] = t; }
+		if(data[mid] < data[hi]) { double t = data[mid]; data[mid] = data[hi]; data[hi] = t; }
+		double pivot = data[hi];
+
+		// Hoare style partition: equal keys split across both sides so runs
+		// of duplicates don't degrade to quadratic
+		long i = lo - 1, j = hi;
+		while(1){
+			while(data[++i] < pivot);
+			while(j > lo && data[--j] > pivot);
+			if(i >= j)
+				break;
+			double t = data[i]; data[i] = data[j]; data[j] = t;
+		}
+		double t = data[i]; data[i] = data[hi]; data[hi] = t;
+
+		if(k == i)
+			return data[k];
+		else if(k < i)
+			hi = i - 1;
+		else
+			lo = i + 1;
+	}
+	for(long i = lo + 1; i <= hi; i++){
+		double v = data[i];
+		long j = i - 1;
+		while(j >= lo && data[j] > v){
+			data[j + 1] = data[j];
+			j--;
+		}
+		data[j + 1] = v;
+	}
+	return data[k];
+}
+
+/*
+ * Computes the exact pct-th percentile of the values in 'data', linearly
+ * interpolating between the two nearest ranks, without sorting the array.
+ * The array is reordered.
+ *
+ * @param size Number of elements in array
+ * @param data Array of data values
+ * @param pct Percentile from 0 to 100
+ *
+ * @return computed percentile of the data array
+ */
+double getPercentile(long size, double *data, double pct){
+	if(size == 0)
+		return 0;
+	double pos = pct / 100 * (size - 1);
+	long k = (long)pos;
+	double lower = selectKth(data, size, k);
+	if(k + 1 >= size || pos == k)
+		return lower;
+	// After selection everything past k is >= data[k], so the next rank is
+	// just the smallest of them
+	double upper = data[k + 1];
+	for(long i = k + 2; i < size; i++){
+		if(data[i] < upper)
+			upper = data[i];
+	}
+	return lower + (upper - lower) * (pos - k);
+}
+
+/*
+ * Computes the median of the values in 'data' in linear time with
+ * introselect.  Same result as getMedian, without the bubble sort.
+ *
+ * @param size Number of elements in array
+ * @param data Array of data values (reordered)
+ *
+ * @return computed median of the data array
+ */
+double getMedianFast(long size, double *data){
+	return getPercentile(size, data, 50);
+}
+
+/*
+ * Computes the mean of 'data' using numThreads threads.
+ *
+ * @param size Number of elements in array
+ * @param data Array of data values
+ * @param numThreads Number of threads to split the array across
+ *
+ * @return computed mean of the data array
+ */
+double getMeanFast(long size, double *data, int numThreads){
+	return parallelSum(data, size, 0, 0, numThreads) / size;
+}
+
+/*
+ * Computes the sample standard deviation of 'data' using numThreads
+ * threads.  Squared deviations from the mean are summed directly (rather
+ * than sum(x^2) - n*mean^2) so there is no catastrophic cancellation.
+ *
+ * @param size Number of elements in array
+ * @param data Array of data values
+ * @param mean Mean of the data values
+ * @param numThreads Number of threads to split the array across
+ *
+ * @return computed standard deviation of data array
+ */
+double getStandardDevFast(long size, double *data, double mean, int numThreads){
+	if(size < 2)
+		return 0;
+	return sqrt(parallelSum(data, size, mean, 1, numThreads) / (size - 1));
+}
+
+/*
+ * Splits 'data' into one chunk per thread, sums each chunk with sumThread
+ * and combines the partial sums with compensation.
+ *
+ * @param data Array of data values
+ * @param size Number of elements in array
+ * @param mean Subtracted from each value when summing squares
+ * @param squares 1 to sum (x - mean)^2, 0 to sum x
+ * @param numThreads Number of threads to use
+ *
+ * @return the sum
+ */
+double parallelSum(double *data, long size, double mean, int squares, int numThreads){
+	if(numThreads > size / 4096 + 1) // not worth a thread per handful of values
+		numThreads = size / 4096 + 1;
+	pthread_t *tid_arr = malloc(numThreads * sizeof(pthread_t));
+	ThreadArgs *thread_args = calloc(numThreads, sizeof(ThreadArgs));
+	long chunk = size / numThreads, start = 0;
+	for(int i = 0; i < numThreads; i++){
+		thread_args[i].data = data;
+		thread_args[i].start = start;
+		thread_args[i].end = i == numThreads - 1 ? size : start + chunk;
+		thread_args[i].mean = mean;
+		thread_args[i].squares = squares;
+		start = thread_args[i].end;
+		pthread_create(&tid_arr[i], NULL, sumThread, (void*)&thread_args[i]);
+	}
+	double sum = 0, comp = 0;
+	for(int i = 0; i < numThreads; i++){
+		pthread_join(tid_arr[i], NULL);
+		// Neumaier's variant of Kahan summation to merge the partials
+		double parts[2] = {thread_args[i].sum, -thread_args[i].comp};
+		for(int j = 0; j < 2; j++){
+			double t = sum + parts[j];
+			if(fabs(sum) >= fabs(parts[j]))
+				comp += (sum - t) + parts[j];
+			else
+				comp += (parts[j] - t) + sum;
+			sum = t;
+		}
+	}
+	free(thread_args);
+	free(tid_arr);
+	return sum + comp;
+}
+
+/*
+ * Thread function for parallelSum: Kahan sums its chunk four lanes at a
+ * time, each lane carrying its own compensation, then folds the lanes and
+ * the leftover tail together.
+ *
+ * @param *thread_args This thread's ThreadArgs
+ */
+void *sumThread(void *thread_args){
+	ThreadArgs *args = (ThreadArgs*)thread_args;
+	double *data = args->data;
+	vec4 sum = {0, 0, 0, 0}, comp = {0, 0, 0, 0};
+	vec4 mean = {args->mean, args->mean, args->mean, args->mean};
+	long i = args->start;
+	for(; i + 4 <= args->end; i += 4){
+		vec4 x;
+		memcpy(&x, &data[i], sizeof(vec4)); // data need not be 32-byte aligned
+		if(args->squares){
+			x -= mean;
+			x *= x;
+		}
+		vec4 y = x - comp;
+		vec4 t = sum + y;
+		comp = (t - sum) - y;
+		sum = t;
+	}
+	double total = 0, c = 0;
+	for(int lane = 0; lane < 4; lane++){
+		double y = sum[lane] - c;
+		double t = total + y;
+		c = (t - total) - y;
+		total = t;
+		c += comp[lane];
+	}
+	for(; i < args->end; i++){
+		double x = args->squares ? (data[i] - args->mean) * (data[i] - args->mean) : data[i];
+		double y = x - c;
+		double t = total + y;
+		c = (t - total) - y;
+		total = t;
+	}
+	args->sum = total;
+	args->comp = c;
+	return NULL;
+}
+
+/*
+ * Seconds elapsed on the monotonic clock since start.
+ */
+double seconds(struct timespec *start){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Benchmarks the original getMean/getStandardDev/getMedian against the
+ * threaded, vectorized and introselect versions on n random values and
+ * prints the times and results side by side.  The bubble sort median is
+ * skipped above BUBBLELIMIT values since it would take hours.
+ *
+ * @param n Number of values to generate
+ * @param numThreads Threads for the fast reductions
+ */
+void runBenchmark(long n, int numThreads){
+	double *data = malloc(n * sizeof(double));
+	double *copy = malloc(n * sizeof(double));
+	if(data == NULL || copy == NULL){
+		printf("Cannot allocate %ld values (%.1f GB needed)\n", n, 2.0 * n * sizeof(double) / 1e9);
+		exit(1);
+	}
+	unsigned short seed[3] = {280, 3, 2019};
+	for(long i = 0; i < n; i++){
+		data[i] = 1000 * erand48(seed) + 1e6; // big offset makes rounding matter
+	}
+	struct timespec start;
+	double t;
+	printf("%ld values, %d threads\n\n", n, numThreads);
+	printf("%-10s %14s %16s %14s %16s\n", "", "original (s)", "original", "fast (s)", "fast");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double mean = getMean(n, data);
+	t = seconds(&start);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double meanFast = getMeanFast(n, data, numThreads);
+	printf("%-10s %14.4f %16.6f %14.4f %16.6f\n", "mean", t, mean, seconds(&start), meanFast);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double std = getStandardDev(n, data, mean);
+	t = seconds(&start);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double stdFast = getStandardDevFast(n, data, meanFast, numThreads);
+	printf("%-10s %14.4f %16.6f %14.4f %16.6f\n", "std dev", t, std, seconds(&start), stdFast);
+
+	memcpy(copy, data, n * sizeof(double));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double medianFast = getMedianFast(n, copy);
+	double tFast = seconds(&start);
+	if(n <= BUBBLELIMIT){
+		memcpy(copy, data, n * sizeof(double));
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		double median = getMedian(n, copy);
+		t = seconds(&start);
+		printf("%-10s %14.4f %16.6f %14.4f %16.6f\n", "median", t, median, tFast, medianFast);
+	}
+	else {
+		printf("%-10s %14s %16s %14.4f %16.6f\n", "median", "skipped", "O(n^2)", tFast, medianFast);
+	}
+	free(copy);
+	free(data);
+}
+
+/*
+ * Maps all of filename into memory.  A writable mapping is private, so
+ * writes only touch our copy-on-write pages, never the file.  Exits if the
+ * file cannot be opened or is empty.
+ *
+ * @param filename Name of the file to map
+ * @param length Set to the file's length in bytes
+ * @param writable 1 to allow writes to the mapping
+ *
+ * @return start of the mapping
+ */
+char *mapFile(char *filename, size_t *length, int writable){
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if(fd == -1 || fstat(fd, &st) == -1){
+		printf("Cannot open %s\n", filename);
+		exit(1);
+	}
+	if(st.st_size == 0){
+		printf("The File is empty");
+		exit(1);
+	}
+	char *map = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0),
+			MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		printf("Cannot map %s\n", filename);
+		exit(1);
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	*length = st.st_size;
+	return map;
+}
+
+/*
+ * Reads every whitespace separated value in the text file filename.  The
+ * file is mapped rather than read, cut into numThreads chunks at
+ * whitespace, and each chunk is parsed by its own thread; the pieces are
+ * then joined in file order.
+ *
+ * @param filename Name of the file containing the values
+ * @param size Set to the number of values read
+ * @param numThreads Number of threads to parse with
+ *
+ * @return malloc'd array of the values, exactly size long
+ */
+double *mapValues(char *filename, long *size, int numThreads){
+	size_t length;
+	char *text = mapFile(filename, &length, 0);
+	if(numThreads > (long)(length / 65536) + 1) // tiny files aren't worth it
+		numThreads = length / 65536 + 1;
+	pthread_t *tid_arr = malloc(numThreads * sizeof(pthread_t));
+	ParseArgs *parse_args = calloc(numThreads, sizeof(ParseArgs));
+	const char *end = text + length, *start = text;
+	for(int i = 0; i < numThreads; i++){
+		parse_args[i].start = start;
+		parse_args[i].end = start = chunkEnd(text, length, start, i, numThreads);
+		pthread_create(&tid_arr[i], NULL, parseThread, (void*)&parse_args[i]);
+	}
+	long total = 0;
+	for(int i = 0; i < numThreads; i++){
+		pthread_join(tid_arr[i], NULL);
+		total += parse_args[i].count;
+	}
+	for(int i = 0; i < numThreads; i++){
+		if(parse_args[i].error != NULL)
+			invalidValue(parse_args[i].error, text, end);
+	}
+	if(total == 0){
+		printf("The File is empty");
+		exit(1);
+	}
+	double *data;
+	if(numThreads == 1){
+		data = parse_args[0].values;
+	}
+	else {
+		data = malloc(total * sizeof(double));
+		long at = 0;
+		for(int i = 0; i < numThreads; i++){
+			memcpy(data + at, parse_args[i].values, parse_args[i].count * sizeof(double));
+			at += parse_args[i].count;
+			free(parse_args[i].values);
+		}
+	}
+	munmap(text, length);
+	free(parse_args);
+	free(tid_arr);
+	*size = total;
+	return data;
+}
+
+/*
+ * Returns where chunk i of numThreads chunks of a mapped text file ends: the
+ * even split point, moved forward to whitespace so no value is split.
+ *
+ * @param text Start of the mapped file
+ * @param length Length of the mapped file
+ * @param start Where the chunk begins (the end of the previous one)
+ * @param i Chunk number
+ * @param numThreads Number of chunks
+ */
+const char *chunkEnd(const char *text, size_t length, const char *start, int i, int numThreads){
+	const char *end = text + length;
+	const char *cut = i == numThreads - 1 ? end : text + length / numThreads * (i + 1);
+	if(cut < start)
+		cut = start;
+	while(cut < end && !isspace((unsigned char)*cut))
+		cut++;
+	return cut;
+}
+
+/*
+ * Reports a token that is not a number and exits.
+ *
+ * @param bad Start of the token
+ * @param text Start of the mapped file, for the byte offset
+ * @param end End of the mapped file
+ */
+void invalidValue(const char *bad, const char *text, const char *end){
+	const char *stop = bad;
+	while(stop < end && stop - bad < 40 && !isspace((unsigned char)*stop))
+		stop++;
+	printf("Invalid value '%.*s' at byte %ld\n", (int)(stop - bad), bad, (long)(bad - text));
+	exit(1);
+}
+
+/*
+ * Maps a file of raw little-endian doubles and uses it in place as the
+ * data array, so nothing is parsed or copied up front.  The mapping is
+ * private and writable since the median is found by reordering the array;
+ * only the pages that get reordered are ever copied.  Free with munmap.
+ *
+ * @param filename Name of the file containing the values
+ * @param size Set to the number of values in the file
+ *
+ * @return the mapped values
+ */
+double *mapBinary(char *filename, long *size){
+	size_t length;
+	char *map = mapFile(filename, &length, 1);
+	if(length % sizeof(double) != 0){
+		printf("%s is %zu bytes, not a whole number of doubles\n", filename, length);
+		exit(1);
+	}
+	double *data = (double*)map;
+	*size = length / sizeof(double);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for(long i = 0; i < *size; i++){
+		uint64_t bits;
+		memcpy(&bits, &data[i], sizeof(bits));
+		bits = __builtin_bswap64(bits);
+		memcpy(&data[i], &bits, sizeof(bits));
+	}
+#endif
+	return data;
+}
+
+/*
+ * Thread function for mapValues: parses every value between start and end.
+ * Parsing stops at the first token that isn't a number.
+ *
+ * @param *parse_args This thread's ParseArgs
+ */
+void *parseThread(void *parse_args){
+	ParseArgs *args = (ParseArgs*)parse_args;
+	const char *p = args->start, *end = args->end;
+	// Guess about 10 bytes per value so most chunks never grow
+	args->capacity = (end - p) / 10 + 16;
+	args->values = malloc(args->capacity * sizeof(double));
+	while(1){
+		while(p < end && isspace((unsigned char)*p))
+			p++;
+		if(p == end)
+			break;
+		if(args->count == args->capacity){
+			args->capacity *= 2;
+			args->values = realloc(args->values, args->capacity * sizeof(double));
+		}
+		const char *next = parseDouble(p, end, &args->values[args->count]);
+		if(next == NULL){
+			args->error = p;
+			break;
+		}
+		args->count++;
+		p = next;
+	}
+	return NULL;
+}
+
+/*
+ * Parses one decimal number starting at p.  Digits are gathered into a
+ * 64-bit integer and scaled by an exact power of ten, which gives the
+ * correctly rounded result whenever the significand fits in 53 bits and the
+ * power of ten is at most 22 -- true for nearly all measured data.  Anything
+ * else (long significands, big exponents, inf, nan, hex) is handed to
+ * strtod.
+ *
+ * @param p Start of the number
+ * @param end End of the text, which need not be NUL terminated
+ * @param value Set to the parsed value
+ *
+ * @return pointer just past the number, or NULL if it isn't one
+ */
+const char *parseDouble(const char *p, const char *end, double *value){
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char *start = p;
+	int negative = 0, digits = 0, exponent = 0, sawDigit = 0;
+	uint64_t mantissa = 0;
+	if(p < end && (*p == '-' || *p == '+')){
+		negative = *p == '-';
+		p++;
+	}
+	for(; p < end && (unsigned)(*p - '0') < 10; p++){
+		sawDigit = 1;
+		if(digits < 19){
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0; // leading zeros aren't significant
+		}
+		else {
+			exponent++;
+		}
+	}
+	if(p < end && *p == '.'){
+		for(p++; p < end && (unsigned)(*p - '0') < 10; p++){
+			sawDigit = 1;
+			if(digits < 19){
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if(sawDigit && p < end && (*p == 'e' || *p == 'E')){
+		const char *e = p + 1;
+		int expNegative = 0, expValue = 0;
+		if(e < end && (*e == '-' || *e == '+')){
+			expNegative = *e == '-';
+			e++;
+		}
+		if(e < end && (unsigned)(*e - '0') < 10){
+			for(; e < end && (unsigned)(*e - '0') < 10; e++){
+				if(expValue < 100000)
+					expValue = expValue * 10 + (*e - '0');
+			}
+			exponent += expNegative ? -expValue : expValue;
+			p = e;
+		}
+	}
+	if(sawDigit && (p == end || isspace((unsigned char)*p))){
+		if(mantissa == 0){
+			*value = negative ? -0.0 : 0.0;
+			return p;
+		}
+		if(mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22){
+			double v = (double)mantissa;
+			v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+			*value = negative ? -v : v;
+			return p;
+		}
+	}
+
+	// Slow path: strtod needs a NUL terminated copy of the token
+	char token[512];
+	p = start;
+	while(p < end && !isspace((unsigned char)*p) && p - start < (long)sizeof(token) - 1)
+		p++;
+	if(p < end && !isspace((unsigned char)*p))
+		return NULL;
+	memcpy(token, start, p - start);
+	token[p - start] = '\0';
+	char *stop;
+	*value = strtod(token, &stop);
+	if(stop != token + (p - start) || stop == token)
+		return NULL;
+	return p;
+}
+
+/*
+ * Table mode: reads a CSV/TSV file once and keeps a RunningStats for every
+ * selected column of every distinct value of the group-by column, then
+ * prints count, mean, standard deviation, min, median, any requested
+ * percentiles and max for each, followed by histograms.  Groups are found
+ * through an open addressing hash table, so each row costs one hash lookup
+ * however many groups there are.  Medians, percentiles and histograms come
+ * from the KLL sketches, to within eps of each group's count.
+ *
+ * The first line is taken as a header when columns are selected by name or
+ * when any of its selected fields isn't a number.  Fields may be quoted
+ * ("" inside quotes is a literal quote) but may not contain newlines.
+ *
+ * @param filename Name of the CSV/TSV file
+ * @param columnSpec Comma separated column names or 1-based numbers, or NULL
+ * 		for every column but the group-by column
+ * @param groupSpec Group-by column name or number, or NULL for no grouping
+ * @param delim Field separator, or 0 to use tab if the first line has one
+ * 		and comma otherwise
+ * @param bins Histogram bins per column (0 for none)
+ * @param eps Rank error bound for the sketches
+ * @param pcts Extra percentiles to print
+ * @param numPcts Number of extra percentiles
+ */
+void tableStats(char *filename, char *columnSpec, char *groupSpec, char delim,
+		int bins, double eps, double *pcts, int numPcts){
+	size_t length;
+	const char *text = mapFile(filename, &length, 0);
+	const char *end = text + length, *p = text;
+	Field *fields = malloc(MAXFIELDS * sizeof(Field));
+
+	// Look at the first line to settle the delimiter, header and columns
+	const char *eol = memchr(p, '\n', end - p);
+	const char *lineEnd = eol == NULL ? end : eol;
+	if(lineEnd > p && lineEnd[-1] == '\r')
+		lineEnd--;
+	if(delim == 0)
+		delim = memchr(p, '\t', lineEnd - p) != NULL ? '\t' : ',';
+	int numHeader = splitFields(p, lineEnd, delim, fields, MAXFIELDS);
+	Field *header = malloc(numHeader * sizeof(Field));
+	memcpy(header, fields, numHeader * sizeof(Field));
+	int hasHeader = (columnSpec != NULL && specHasNames(columnSpec)) ||
+			(groupSpec != NULL && specHasNames(groupSpec));
+	int groupColumn = groupSpec == NULL ? -1 : findColumn(groupSpec, header, numHeader, hasHeader);
+
+	int columns[MAXCOLS], numColumns = 0;
+	if(columnSpec != NULL) {
+		char *spec = strdup(columnSpec), *save = NULL;
+		for(char *name = strtok_r(spec, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)){
+			if(numColumns == MAXCOLS){
+				printf("At most %d columns can be selected\n", MAXCOLS);
+				exit(1);
+			}
+			columns[numColumns++] = findColumn(name, header, numHeader, hasHeader);
+		}
+		free(spec);
+	}
+	else {
+		for(int i = 0; i < numHeader; i++){
+			if(i == groupColumn)
+				continue;
+			if(numColumns == MAXCOLS){
+				printf("Only the first %d columns are summarized; select others with -c\n", MAXCOLS);
+				break;
+			}
+			columns[numColumns++] = i;
+		}
+	}
+	if(numColumns == 0){
+		printf("No columns to summarize\n");
+		exit(1);
+	}
+	if(!hasHeader) {
+		double value;
+		for(int i = 0; i < numColumns; i++){
+			if(columns[i] >= numHeader)
+				continue;
+			Field *f = &header[columns[i]];
+			if(f->len > 0 && parseDouble(f->start, f->start + f->len, &value) == NULL)
+				hasHeader = 1;
+		}
+	}
+	if(hasHeader)
+		p = eol == NULL ? end : eol + 1;
+
+	GroupTable table;
+	groupsInit(&table, numColumns, eps);
+	long rows = 0, skipped = 0;
+	while(p < end){
+		eol = memchr(p, '\n', end - p);
+		lineEnd = eol == NULL ? end : eol;
+		const char *next = eol == NULL ? end : eol + 1;
+		if(lineEnd > p && lineEnd[-1] == '\r')
+			lineEnd--;
+		if(lineEnd == p){
+			p = next;
+			continue;
+		}
+		int numFields = splitFields(p, lineEnd, delim, fields, MAXFIELDS);
+		Group *group;
+		if(groupColumn >= 0 && groupColumn < numFields)
+			group = findGroup(&table, fields[groupColumn].start, fields[groupColumn].len);
+		else
+			group = findGroup(&table, "", 0);
+		group->rows++;
+		rows++;
+		for(int i = 0; i < numColumns; i++){
+			double value;
+			Field *f = &fields[columns[i]];
+			if(columns[i] >= numFields || f->len == 0)
+				continue;
+			if(parseDouble(f->start, f->start + f->len, &value) == NULL){
+				skipped++;
+				continue;
+			}
+			statsAdd(&group->columns[i], value);
+		}
+		p = next;
+	}
+	if(rows == 0){
+		printf("The File is empty");
+		exit(1);
+	}
+
+	// Name each column after its header field, or its number
+	char **names = malloc(numColumns * sizeof(char*));
+	for(int i = 0; i < numColumns; i++){
+		names[i] = malloc(64);
+		if(hasHeader && columns[i] < numHeader)
+			snprintf(names[i], 64, "%.*s", header[columns[i]].len, header[columns[i]].start);
+		else
+			snprintf(names[i], 64, "column %d", columns[i] + 1);
+	}
+
+	qsort(table.groups, table.count, sizeof(Group), compareGroups);
+	printf("\n%ld rows", rows);
+	if(groupColumn >= 0)
+		printf(", %d groups", table.count);
+	printf(", %ld non-numeric values skipped\n", skipped);
+	for(int g = 0; g < table.count; g++){
+		Group *group = &table.groups[g];
+		printf("\n");
+		if(groupColumn >= 0)
+			printf("%.*s (%ld rows)\n", group->keyLen, group->key, group->rows);
+		printf("%-16s %10s %12s %12s %12s %12s", "column", "count", "mean", "std dev", "min", "median");
+		for(int i = 0; i < numPcts; i++){
+			char label[16];
+			snprintf(label, sizeof(label), "p%g", pcts[i]);
+			printf(" %12s", label);
+		}
+		printf(" %12s\n", "max");
+		for(int i = 0; i < numColumns; i++){
+			RunningStats *stats = &group->columns[i];
+			if(stats->count == 0){
+				printf("%-16s %10d\n", names[i], 0);
+				continue;
+			}
+			double std = stats->count > 1 ? sqrt(stats->m2 / (stats->count - 1)) : 0;
+			printf("%-16s %10ld %12.3f %12.3f %12.3f %12.3f", names[i], stats->count,
+					stats->sum / stats->count, std, stats->min, kllQuantile(&stats->sketch, 0.5));
+			for(int j = 0; j < numPcts; j++){
+				printf(" %12.3f", kllQuantile(&stats->sketch, pcts[j] / 100));
+			}
+			printf(" %12.3f\n", stats->max);
+		}
+		for(int i = 0; i < numColumns && bins > 0; i++){
+			printHistogram(names[i], &group->columns[i], bins);
+		}
+	}
+	printf("\n");
+
+	for(int i = 0; i < numColumns; i++){
+		free(names[i]);
+	}
+	free(names);
+	groupsFree(&table);
+	free(header);
+	free(fields);
+	munmap((void*)text, length);
+}
+
+/*
+ * Splits one line into fields at delim.  Unquoted fields are trimmed of
+ * surrounding spaces; quoted fields lose their quotes.  Fields point into
+ * the line, nothing is copied.
+ *
+ * @param p Start of the line
+ * @param end End of the line (not including the newline)
+ * @param delim Field separator
+ * @param fields Array to fill in
+ * @param maxFields Length of fields; later fields are ignored
+ *
+ * @return number of fields found
+ */
+int splitFields(const char *p, const char *end, char delim, Field *fields, int maxFields){
+	int n = 0;
+	while(n < maxFields){
+		while(p < end && *p == ' ')
+			p++;
+		const char *start = p, *stop;
+		if(p < end && *p == '"'){
+			start = ++p;
+			while(p < end && !(*p == '"' && (p + 1 == end || p[1] != '"')))
+				p += *p == '"' ? 2 : 1;
+			stop = p < end ? p : end;
+			while(p < end && *p != delim)
+				p++;
+		}
+		else {
+			while(p < end && *p != delim)
+				p++;
+			stop = p;
+			while(stop > start && stop[-1] == ' ')
+				stop--;
+		}
+		fields[n].start = start;
+		fields[n].len = stop - start;
+		n++;
+		if(p >= end)
+			break;
+		p++;
+	}
+	return n;
+}
+
+/*
+ * Returns 1 if a column list names any column rather than giving numbers.
+ */
+int specHasNames(char *spec){
+	for(; *spec != '\0'; spec++){
+		if(*spec != ',' && (*spec < '0' || *spec > '9'))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Resolves a column name or 1-based number to a 0-based column index.
+ * Exits if the column doesn't exist.
+ *
+ * @param spec Column name or number
+ * @param header Fields of the first line
+ * @param numHeader Number of fields in the first line
+ * @param hasHeader 1 if the first line holds column names
+ *
+ * @return index of the column
+ */
+int findColumn(char *spec, Field *header, int numHeader, int hasHeader){
+	if(!specHasNames(spec)){
+		int column = atoi(spec);
+		if(column < 1 || column > MAXFIELDS){
+			printf("Invalid column number: %s\n", spec);
+			exit(1);
+		}
+		return column - 1;
+	}
+	for(int i = 0; hasHeader && i < numHeader; i++){
+		if(header[i].len == (int)strlen(spec) && memcmp(header[i].start, spec, header[i].len) == 0)
+			return i;
+	}
+	printf("No column named %s\n", spec);
+	exit(1);
+}
+
+/*
+ * Starts an empty group table.
+ *
+ * @param table Table to initialize
+ * @param numColumns Number of columns each group accumulates
+ * @param eps Rank error bound for each column's sketch
+ */
+void groupsInit(GroupTable *table, int numColumns, double eps){
+	table->count = 0;
+	table->capacity = 16;
+	table->groups = malloc(table->capacity * sizeof(Group));
+	table->numSlots = 32;
+	table->slots = malloc(table->numSlots * sizeof(int));
+	memset(table->slots, -1, table->numSlots * sizeof(int));
+	table->numColumns = numColumns;
+	table->eps = eps;
+}
+
+/*
+ * Returns the group for key, adding an empty one the first time a key is
+ * seen.  Lookups probe linearly from the key's hash; the slot array is
+ * doubled whenever it gets half full so probes stay short.
+ *
+ * @param table Table to search
+ * @param key Group key (not NUL terminated)
+ * @param keyLen Length of key
+ *
+ * @return the key's group
+ */
+Group *findGroup(GroupTable *table, const char *key, int keyLen){
+	unsigned int mask = table->numSlots - 1;
+	unsigned int slot = hashKey(key, keyLen) & mask;
+	while(table->slots[slot] != -1){
+		Group *group = &table->groups[table->slots[slot]];
+		if(group->keyLen == keyLen && memcmp(group->key, key, keyLen) == 0)
+			return group;
+		slot = (slot + 1) & mask;
+	}
+
+	if(table->count == table->capacity){
+		table->capacity *= 2;
+		table->groups = realloc(table->groups, table->capacity * sizeof(Group));
+	}
+	Group *group = &table->groups[table->count];
+	group->key = malloc(keyLen + 1);
+	memcpy(group->key, key, keyLen);
+	group->key[keyLen] = '\0';
+	group->keyLen = keyLen;
+	group->rows = 0;
+	group->columns = malloc(table->numColumns * sizeof(RunningStats));
+	for(int i = 0; i < table->numColumns; i++){
+		statsInit(&group->columns[i], table->eps);
+	}
+	table->slots[slot] = table->count++;
+
+	if(table->count * 2 > table->numSlots){
+		free(table->slots);
+		table->numSlots *= 2;
+		table->slots = malloc(table->numSlots * sizeof(int));
+		memset(table->slots, -1, table->numSlots * sizeof(int));
+		mask = table->numSlots - 1;
+		for(int i = 0; i < table->count; i++){
+			slot = hashKey(table->groups[i].key, table->groups[i].keyLen) & mask;
+			while(table->slots[slot] != -1)
+				slot = (slot + 1) & mask;
+			table->slots[slot] = i;
+		}
+	}
+	return group;
+}
+
+/*
+ * Frees every group and the table's arrays.
+ */
+void groupsFree(GroupTable *table){
+	for(int g = 0; g < table->count; g++){
+		for(int i = 0; i < table->numColumns; i++){
+			kllFree(&table->groups[g].columns[i].sketch);
+		}
+		free(table->groups[g].columns);
+		free(table->groups[g].key);
+	}
+	free(table->groups);
+	free(table->slots);
+}
+
+/*
+ * 32-bit FNV-1a hash of a group key.
+ */
+unsigned int hashKey(const char *key, int len){
+	unsigned int hash = 2166136261u;
+	for(int i = 0; i < len; i++){
+		hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * qsort comparison putting groups in key order.
+ */
+int compareGroups(const void *a, const void *b){
+	const Group *x = a, *y = b;
+	int n = x->keyLen < y->keyLen ? x->keyLen : y->keyLen;
+	int cmp = memcmp(x->key, y->key, n);
+	return cmp != 0 ? cmp : x->keyLen - y->keyLen;
+}
+
+/*
+ * Prints a histogram of one column's values in equal width bins from its
+ * min to its max, with a bar scaled to the fullest bin.  Counts are
+ * estimated from the column's sketch.  A column holding a single value
+ * gets a single bin.
+ *
+ * @param name Column name
+ * @param stats The column's running statistics
+ * @param bins Number of bins
+ */
+void printHistogram(char *name, RunningStats *stats, int bins){
+	if(stats->count == 0)
+		return;
+	if(stats->min == stats->max)
+		bins = 1;
+	long *counts = calloc(bins, sizeof(long));
+	kllHistogram(&stats->sketch, stats->min, stats->max, counts, bins);
+	long most = 1;
+	for(int i = 0; i < bins; i++){
+		if(counts[i] > most)
+			most = counts[i];
+	}
+	double width = (stats->max - stats->min) / bins;
+	printf("  %s histogram:\n", name);
+	for(int i = 0; i < bins; i++){
+		int bar = (int)(counts[i] * 40 / most);
+		printf("    [%12.3f, %12.3f%c %10ld  %.*s\n", stats->min + i * width,
+				i == bins - 1 ? stats->max : stats->min + (i + 1) * width,
+				i == bins - 1 ? ']' : ')', counts[i], bar,
+				"########################################");
+	}
+	free(counts);
+}
+
+/*
+ * Adds the weight of every item in the sketch to one of bins equal width
+ * bins spanning lo to hi.  The weights add up to the number of values
+ * added, and each bin's total is within the sketch's rank error of the
+ * exact count.
+ *
+ * @param sketch Sketch to read
+ * @param lo Lower edge of the first bin
+ * @param hi Upper edge of the last bin (inclusive)
+ * @param counts Array of bins counts to add to
+ * @param bins Number of bins
+ */
+void kllHistogram(KllSketch *sketch, double lo, double hi, long *counts, int bins){
+	double scale = hi > lo ? bins / (hi - lo) : 0;
+	for(int h = 0; h < sketch->numLevels; h++){
+		for(int i = 0; i < sketch->levels[h].n; i++){
+			int bin = (int)((sketch->levels[h].items[i] - lo) * scale);
+			if(bin < 0)
+				bin = 0;
+			if(bin >= bins)
+				bin = bins - 1;
+			counts[bin] += 1L << h;
+		}
+	}
+}
@@ -11,58 +11,266 @@
  * 		- Exit the shell with the 'exit' command
  * 		- Display a list of N most recently executed commands using 'history' command
  * 		- Execute a command from history using the '!num' command, where num is the ID
- * 			corresponding to a command from the history log (ex. !4)
+ * 			corresponding to a command from the history log (ex. !4), or the
+ * 			most recent command starting with some text using '!text'
+ * 		- Search the whole saved history with 'history -s pattern'
+ * 		- List or reset the remembered locations of commands with 'hash'
+ * 		- Run a command over many arguments, N at a time, with 'parallel'
+ * 		- Run a script, 'ttsh script.sh', or a command string, 'ttsh -c "..."',
+ * 			stopping at the first failing command with 'set -e' or 'ttsh -e'
  * 		-Change the current working directory with the 'cd' command
+ * 		- Connect commands with '|' pipelines and redirect their input and
+ * 			output with '<', '>', '>>' and '2>'
+ * 		- Compare command launch latency with 'spawnbench'
+ * 		- List, resume and background jobs with 'jobs', 'fg' and 'bg'
+ * 		- Report a command's wall clock time, CPU time and peak memory by
+ * 			prefixing it with 'time'
+ *
+ * Commands are launched with posix_spawn, which glibc implements with a
+ * vfork-style clone that shares the shell's memory instead of copying its
+ * page tables, so launch cost doesn't grow with the shell's size.  fork is
+ * used if posix_spawn itself cannot start a process.  The $PATH search is
+ * done by the shell, once per command name, and the program is then started
+ * directly from the remembered path.
+ *
+ * SIGCHLD only writes to a self-pipe; children are reaped with wait4 from the
+ * main loop, which keeps each job's status and resource usage in a job table.
+ *
+ * Scripts are read through a large stdio buffer with no prompt, debug echo,
+ * history or job control, so each line costs little more than its launch.
  */
 
 // NOTE: all new includes should go after the following #define
 #define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE     // wait4, timeradd/timersub and NSIG
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
 #include "parse_args.h"
 #include "history_queue.h"
 
-void foreground_handler(char *argv[]);
-void background_handler(char *argv[]);
+#define MAXSTAGES 16
+#define MAXJOBS 64
+#define PATHSLOTS 512     // command path cache size, a power of two
+#define SCRIPTBUF (1 << 20) // input buffer for scripts
+#define SCRIPTSHELL "/bin/sh" // runs executables that have no #! line
+
+#define JOB_RUNNING 1
+#define JOB_STOPPED 2
+#define JOB_DONE 3
+
+extern char **environ;
+
+// One command of a pipeline along with its redirections
+struct Stage {
+	char **argv;       // NULL terminated, points into Pipeline.args
+	char *infile;      // < file
+	char *outfile;     // > file or >> file
+	int append;        // 1 for >>
+	char *errfile;     // 2> file
+};
+typedef struct Stage Stage;
+
+// Commands connected by '|', run and waited for together
+struct Pipeline {
+	Stage stages[MAXSTAGES];
+	int num_stages;
+	char *args[MAXARGS + MAXSTAGES];
+};
+typedef struct Pipeline Pipeline;
+
+// A pipeline started by the shell, tracked until all its processes exit
+struct Job {
+	int id;                     // job number for fg/bg, 0 if the slot is free
+	pid_t pgid;                 // process group, 0 if it shares the shell's
+	pid_t pids[MAXSTAGES];
+	int exited[MAXSTAGES];
+	int stopped[MAXSTAGES];
+	int num_pids;
+	int num_live;               // processes that haven't exited
+	int state;                  // JOB_RUNNING, JOB_STOPPED or JOB_DONE
+	int reported;               // last state the user was told about
+	int status;                 // wait status of the last command
+	int timed;                  // print resource usage when done
+	struct timespec start;      // CLOCK_MONOTONIC, taken before the first spawn
+	struct timespec end;
+	struct rusage usage;        // summed CPU times, largest max RSS
+	char cmdline[MAXLINE];
+};
+typedef struct Job Job;
+
+static Job jobs[MAXJOBS];
+
+// SIGCHLD writes to [1]; the main loop drains [0] and reaps
+static int sigchld_pipe[2];
+
+// Job control is only done when stdin is a terminal
+static int interactive = 0;
+static pid_t shell_pgid;
+
+// A command name and the program it runs
+struct PathEntry {
+	char *name;            // NULL if the slot is empty
+	char *path;
+	unsigned int hits;
+};
+typedef struct PathEntry PathEntry;
+
+// Command path cache (open addressing) and the $PATH it was filled from
+static PathEntry path_cache[PATHSLOTS];
+static int path_cache_count = 0;
+static char *cached_path_var = NULL;
+
+// One command run by the 'parallel' builtin
+struct ParallelTask {
+	pid_t pid;             // 0 once reaped
+	int out_fd;            // read end of its stdout pipe, -1 after EOF
+	int done;              // exited and all output collected
+	char *output;
+	size_t len;
+	size_t cap;
+};
+typedef struct ParallelTask ParallelTask;
+
+// 1 to launch with fork + execv rather than posix_spawn (spawnbench)
+static int use_fork = 0;
+
+// Exit status of the last command, and whether to exit when it isn't 0
+static int last_status = 0;
+static int errexit = 0;
+
+void foreground_handler(Pipeline *pipeline, char *cmdline, int timed);
+void background_handler(Pipeline *pipeline, char *cmdline, int timed);
+int parse_pipeline(char *argv[], Pipeline *pipeline);
+int start_pipeline(Pipeline *pipeline, pid_t pids[], pid_t *pgid);
+pid_t spawn_stage(char *argv[], int fds[3], pid_t pgid);
+char **script_argv(char *path, char *argv[]);
+int open_redirect(char *filename, int flags);
+void spawn_bench(char *argv[]);
+char *lookup_command(char *name);
+char *search_path(char *name, char *path_var);
+unsigned int find_path_slot(char *name);
+void clear_path_cache();
+void forget_command(char *name);
+int path_has_relative_dirs();
+void hash_builtin(char *argv[]);
+void parallel_builtin(char *argv[]);
+void parallel_add_arg(char ***args, int *num_args, int *args_cap, const char *arg, size_t len);
+int parallel_start(ParallelTask *task, char **command, int command_len, char *arg);
+void parallel_read(ParallelTask *task);
+void parallel_print(ParallelTask *task, char *arg, int tag);
 void child_handler(__attribute__ ((unused)) int sig);
+void reap_children();
+void update_job(pid_t pid, int status, struct rusage *usage);
+void report_jobs();
+Job *reserve_job();
+void add_job(Job *slot, pid_t pids[], int num_pids, pid_t pgid, char *cmdline, int timed,
+		struct timespec *start);
+Job *find_job(char *arg);
+void signal_job(Job *job, int sig);
+void wait_for_job(Job *job);
+void print_usage(Job *job);
+void print_jobs();
+void continue_job(char *argv[], int foreground);
+void init_shell(int script);
+void set_builtin(char *argv[]);
+int exit_status(int status);
+void shell_signals(sigset_t *set);
 void add_entry(HistoryEntry val);
 void print_history();
 char *run_history(char *old_cmd);
 char *find_cmd(unsigned int hist_id);
-void execute_command(char *argv[], int process_state);
+char *find_prefix(const char *prefix);
+void search_history(const char *pattern);
+unsigned int history_init();
+void history_builtin(char *argv[]);
+void execute_command(char *argv[], int process_state, char *cmdline);
 void add_history(unsigned int *history_id, char *cmdline);
 
-int main() {
-	// Call to sigaction to register your SIGCHLD signal handler
-	struct sigaction sa;
-	sa.sa_handler = child_handler;
-	sa.sa_flags = SA_NOCLDSTOP;     // don't call handler on child pause/resume
-	sigaction(SIGCHLD, &sa, NULL);
-	unsigned int history_id = 1;
+int main(int argc, char *argv_main[]) {
+	FILE *input = stdin;
+	int script = 0, c;
+	unsigned int history_id = 0;
+
+	while ((c = getopt(argc, argv_main, "+c:e")) != -1) {
+		switch (c) {
+			case 'c':
+				input = fmemopen(optarg, strlen(optarg), "r");
+				script = 1;
+				break;
+			case 'e':
+				errexit = 1;
+				break;
+			default:
+				printf("usage: %s [-e] [-c commands | script]\n", argv_main[0]);
+				exit(2);
+		}
+	}
+	if (!script && optind < argc) {
+		input = fopen(argv_main[optind], "re"); // not inherited by commands
+		if (input == NULL) {
+			printf("Error: cannot open %s\n", argv_main[optind]);
+			exit(127);
+		}
+		script = 1;
+	}
+	if (script)
+		setvbuf(input, NULL, _IOFBF, SCRIPTBUF);
+	init_shell(script);
+	// Like other shells, only a terminal session reads and saves history,
+	// so commands piped into ttsh don't end up in the history file
+	if (interactive)
+		history_id = history_init();
 
 	while(1) {
+		reap_children();
+		report_jobs();
+
 		// Print the shell prompt
-		fprintf(stdout, "ttsh> ");
-		fflush(stdout);
+		if (!script) {
+			fprintf(stdout, "ttsh> ");
+			fflush(stdout);
+		}
 
 		// (2) Read in the next command entered by the user
 		char cmdline[MAXLINE];
-		if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin)) {
-			// fgets could be interrupted by a signal.
-			// This checks to see if that happened, in which case we simply
-			// clear out the error and restart our loop so it re-prompts the
-			// user for a command.
-			clearerr(stdin);
-			continue;
+		if (fgets(cmdline, MAXLINE, input) == NULL) {
+			if (ferror(input)) {
+				// fgets could be interrupted by a signal.
+				// This checks to see if that happened, in which case we simply
+				// clear out the error and restart our loop so it re-prompts the
+				// user for a command.
+				clearerr(input);
+				continue;
+			}
+			// End of input (a last line without a newline has already run)
+			fflush(stdout);
+			exit(last_status);
 		}
 
-		if (feof(stdin)) {
-			fflush(stdout);
-			exit(0);
+		// Skip blank lines and comments, including a #! line
+		char *first = cmdline + strspn(cmdline, " \t");
+		if (*first == '#' || *first == '\n' || *first == '\0')
+			continue;
+
+		if (script) {
+			// Scripts get neither the debug echo nor history
+			char *argv[MAXARGS];
+			int process_state = parseArguments(cmdline, argv);
+			execute_command(argv, process_state, cmdline);
+			continue;
 		}
 
 		// TODO: remove this line after you are done testing/debugging.
@@ -80,14 +288,54 @@ int main() {
 
 				 //restarts the loop if the history_id does not exist
 		}
-		add_history(&history_id, cmdline);
+		if (interactive)
+			add_history(&history_id, cmdline);
 		// 0 means foreground, non-zero means background
 		int process_state = parseArguments(cmdline, argv);
-		execute_command(argv, process_state);
+		execute_command(argv, process_state, cmdline);
 	}
 	return 0;
 }
 
+/* Sets up the self-pipe and SIGCHLD handler and, when running interactively
+ * on a terminal, puts the shell in its own process group in charge of the
+ * terminal and ignores the job control signals so that only the foreground
+ * job gets them.
+ *
+ * @param script 1 if running a script or -c commands (no job control)
+ */
+void init_shell(int script) {
+	if (pipe(sigchld_pipe) == -1) {
+		printf("Error: cannot create pipe.\n");
+		exit(1);
+	}
+	for (int i = 0; i < 2; i++) {
+		fcntl(sigchld_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	// Call to sigaction to register your SIGCHLD signal handler.  Without
+	// SA_RESTART a child exiting interrupts fgets, so the prompt loop gets
+	// to report it right away.
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = child_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	interactive = !script && isatty(STDIN_FILENO);
+	if (interactive) {
+		signal(SIGINT, SIG_IGN);
+		signal(SIGQUIT, SIG_IGN);
+		signal(SIGTSTP, SIG_IGN);
+		signal(SIGTTIN, SIG_IGN);
+		signal(SIGTTOU, SIG_IGN);
+		shell_pgid = getpid();
+		setpgid(0, shell_pgid);
+		tcsetpgrp(STDIN_FILENO, shell_pgid);
+	}
+}
+
 void add_history(unsigned int *history_id, char *cmdline) {
 	HistoryEntry entry;
 	entry.cmd_num = (*history_id)++;
@@ -100,96 +348,1210 @@ void add_history(unsigned int *history_id, char *cmdline) {
  *
  * @param argv user's command line
  * @param process_state executes in foreground if 0, background if 1
+ * @param cmdline the line as typed, for the job table
  */
-void execute_command(char *argv[], int process_state){
-	if(strcmp(argv[0], "exit") == 0)
-		exit(0);
+void execute_command(char *argv[], int process_state, char *cmdline){
+	Pipeline pipeline;
+	int timed = 0;
+	if(argv[0] != NULL && strcmp(argv[0], "time") == 0) {
+		timed = 1;
+		argv++;
+	}
+	if(argv[0] == NULL) {
+		if (timed)
+			printf("usage: time command [args...]\n");
+		return;
+	}
+	last_status = 0;
+	if(strcmp(argv[0], "exit") == 0) {
+		fflush(stdout);
+		exit(argv[1] != NULL ? atoi(argv[1]) : 0);
+	}
 	else if (strcmp(argv[0], "cd") == 0) {
 		if (argv[1] == NULL)
 			chdir(getenv("HOME"));
-		else if (chdir(argv[1]) == -1)
+		else if (chdir(argv[1]) == -1) {
 			printf("Error: Directory %s does not exist.\n", argv[1]);
+			last_status = 1;
+		}
+		if (path_has_relative_dirs())
+			clear_path_cache();
 	}
+	else if (strcmp(argv[0], "hash") == 0)
+		hash_builtin(argv);
+	else if (strcmp(argv[0], "parallel") == 0)
+		parallel_builtin(argv);
+	else if (strcmp(argv[0], "set") == 0)
+		set_builtin(argv);
 	else if (strcmp(argv[0], "history") == 0)
-		print_history();
+		history_builtin(argv);
+	else if (strcmp(argv[0], "jobs") == 0)
+		print_jobs();
+	else if (strcmp(argv[0], "fg") == 0 || strcmp(argv[0], "bg") == 0)
+		continue_job(argv, argv[0][0] == 'f');
+	else if (strcmp(argv[0], "spawnbench") == 0)
+		spawn_bench(argv);
+	else if (parse_pipeline(argv, &pipeline) == -1)
+		last_status = 2;
 	else if (process_state == 0)
-		foreground_handler(argv);
+		foreground_handler(&pipeline, cmdline, timed);
 	else
-		background_handler(argv);
+		background_handler(&pipeline, cmdline, timed);
+
+	if (errexit && last_status != 0) {
+		fflush(stdout);
+		exit(last_status);
+	}
+}
+
+/* Builtin 'set': 'set -e' makes the shell exit as soon as a command fails
+ * (as 'ttsh -e' does) and 'set +e' turns that off again.
+ *
+ * @param argv the builtin's command line
+ */
+void set_builtin(char *argv[]) {
+	for (int i = 1; argv[i] != NULL; i++) {
+		if (strcmp(argv[i], "-e") == 0)
+			errexit = 1;
+		else if (strcmp(argv[i], "+e") == 0)
+			errexit = 0;
+		else {
+			printf("usage: set [-e | +e]\n");
+			last_status = 2;
+		}
+	}
+}
+
+/* Converts a wait status to a shell exit status: the exit code, or 128 plus
+ * the signal number for a command killed by a signal.
+ */
+int exit_status(int status) {
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return 1;
 }
 
 /* User specified command is to be executed in foreground: command is executed by child
  * process while the parent process waits for it to complete.  The parent then
- * completes.  During this time, the shell cannot execute other commands.
+ * completes.  During this time, the shell cannot execute other commands.  A
+ * pipeline is waited on as a whole: the shell returns once every stage exits,
+ * or when the job is stopped (^Z) and can be resumed with fg or bg.
  *
- * @param argv user's command line
+ * @param pipeline user's parsed command line
+ * @param cmdline the line as typed, for the job table
+ * @param timed 1 to print the job's resource usage when it finishes
  */
-void foreground_handler(char *argv[]) {
-	pid_t pid;
-	int status;
+void foreground_handler(Pipeline *pipeline, char *cmdline, int timed) {
+	pid_t pids[MAXSTAGES];
+	pid_t pgid;
+	struct timespec start;
 
-	pid = fork();
-	if(pid == 0) {
-		if(execvp(argv[0], argv) == -1) {
-			printf("Error: Invalid command: %s\n", argv[0]);
-			exit(1);
-		}
-		exit(0);
-	}
-	else if(pid < 0) {
-		printf("Error: Forking error.\n");
-		exit(1);
+	// Take the slot first: with no slot the children could never be waited on
+	Job *job = reserve_job();
+	if (job == NULL) {
+		last_status = 1;
+		return;
 	}
-	waitpid(pid, &status, WUNTRACED);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int num_pids = start_pipeline(pipeline, pids, &pgid);
+	add_job(job, pids, num_pids, pgid, cmdline, timed, &start);
+	wait_for_job(job);
 }
 
 /* User specified command is to be executed in the background: command is
  * executed by child process, but the parent process does not wait for the
  * child to exit.  Instead, the parent process is free to take in new
- * commands.
+ * commands.  The job is reported at a prompt once it finishes.
  *
- * @param argv user's command line
+ * @param pipeline user's parsed command line
+ * @param cmdline the line as typed, for the job table
+ * @param timed 1 to print the job's resource usage when it finishes
+ */
+void background_handler(Pipeline *pipeline, char *cmdline, int timed) {
+	pid_t pids[MAXSTAGES];
+	pid_t pgid;
+	struct timespec start;
+
+	Job *job = reserve_job();
+	if (job == NULL) {
+		last_status = 1;
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int num_pids = start_pipeline(pipeline, pids, &pgid);
+	add_job(job, pids, num_pids, pgid, cmdline, timed, &start);
+	if (num_pids > 0)
+		printf("[%d] %d\n", job->id, pids[num_pids - 1]);
+}
+
+/* Splits a parsed command line into the commands of a pipeline and pulls out
+ * their redirections.  Operators must be separate words ("a | b"), except that
+ * a redirection may be attached to its file name (">out", "2>err").
+ *
+ * @param argv user's command line, as split by parseArguments
+ * @param pipeline filled in with the commands and their redirections
+ * @return 0 on success, -1 (after printing an error) if the line is malformed
+ */
+int parse_pipeline(char *argv[], Pipeline *pipeline) {
+	int num_args = 0;
+	Stage *stage = &pipeline->stages[0];
+
+	memset(pipeline, 0, sizeof(Pipeline));
+	stage->argv = pipeline->args;
+	for (int i = 0; argv[i] != NULL; i++) {
+		char *word = argv[i];
+		char **target;
+		int skip;
+
+		if (strcmp(word, "|") == 0) {
+			if (stage->argv == &pipeline->args[num_args]) {
+				printf("Error: missing command before '|'\n");
+				return -1;
+			}
+			if (stage == &pipeline->stages[MAXSTAGES - 1]) {
+				printf("Error: pipelines are limited to %d commands\n", MAXSTAGES);
+				return -1;
+			}
+			pipeline->args[num_args++] = NULL;
+			stage++;
+			stage->argv = &pipeline->args[num_args];
+			continue;
+		}
+
+		if (strncmp(word, "2>", 2) == 0) {
+			target = &stage->errfile;
+			skip = 2;
+		}
+		else if (strncmp(word, ">>", 2) == 0) {
+			target = &stage->outfile;
+			stage->append = 1;
+			skip = 2;
+		}
+		else if (word[0] == '>') {
+			target = &stage->outfile;
+			stage->append = 0;
+			skip = 1;
+		}
+		else if (word[0] == '<') {
+			target = &stage->infile;
+			skip = 1;
+		}
+		else {
+			pipeline->args[num_args++] = word;
+			continue;
+		}
+
+		if (word[skip] != '\0')
+			*target = word + skip;
+		else if (argv[i + 1] != NULL)
+			*target = argv[++i];
+		else {
+			printf("Error: missing file name after '%s'\n", word);
+			return -1;
+		}
+	}
+	if (stage->argv == &pipeline->args[num_args]) {
+		printf("Error: missing command%s\n", stage == pipeline->stages ? "" : " after '|'");
+		return -1;
+	}
+	pipeline->args[num_args] = NULL;
+	pipeline->num_stages = stage - pipeline->stages + 1;
+	return 0;
+}
+
+/* Starts every command of a pipeline, each reading the previous one's output
+ * through a pipe.  File redirections take the place of the pipe on that
+ * side.  A command that cannot be started is reported and skipped, so its
+ * neighbours see end of file or a closed pipe.  In an interactive shell the
+ * commands are put in a new process group named after the first of them.
+ *
+ * @param pipeline commands to start
+ * @param pids filled in with the process ID of each command started
+ * @param pgid set to the pipeline's process group, or 0 if it has none
+ * @return number of processes started
+ */
+int start_pipeline(Pipeline *pipeline, pid_t pids[], pid_t *pgid) {
+	int num_pids = 0;
+	int prev_read = -1;
+
+	*pgid = 0;
+	// Anything we printed must come out before the commands' output
+	fflush(stdout);
+
+	for (int i = 0; i < pipeline->num_stages; i++) {
+		Stage *stage = &pipeline->stages[i];
+		int fds[3] = {prev_read, -1, -1};
+		int pipe_fds[2] = {-1, -1};
+
+		if (i < pipeline->num_stages - 1) {
+			if (pipe(pipe_fds) == -1) {
+				printf("Error: cannot create pipe.\n");
+				break;
+			}
+			// Every child gets the ends it needs through dup2; the
+			// originals must not leak into the other children
+			fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+			fcntl(pipe_fds[1], F_SETFD, FD_CLOEXEC);
+			fds[1] = pipe_fds[1];
+		}
+		if (stage->infile != NULL) {
+			if (fds[0] != -1)
+				close(fds[0]);
+			fds[0] = open_redirect(stage->infile, O_RDONLY);
+		}
+		if (stage->outfile != NULL) {
+			// The pipe's write end is closed below either way
+			fds[1] = open_redirect(stage->outfile,
+					O_WRONLY | O_CREAT | (stage->append ? O_APPEND : O_TRUNC));
+		}
+		if (stage->errfile != NULL)
+			fds[2] = open_redirect(stage->errfile, O_WRONLY | O_CREAT | O_TRUNC);
+
+		if ((stage->infile == NULL || fds[0] != -1) &&
+				(stage->outfile == NULL || fds[1] != -1) &&
+				(stage->errfile == NULL || fds[2] != -1)) {
+			pid_t pid = spawn_stage(stage->argv, fds, interactive ? *pgid : -1);
+			if (pid > 0) {
+				pids[num_pids++] = pid;
+				if (interactive && *pgid == 0)
+					*pgid = pid;
+			}
+		}
+
+		// The children hold their own copies now
+		for (int fd = 0; fd < 3; fd++) {
+			if (fds[fd] != -1)
+				close(fds[fd]);
+		}
+		if (pipe_fds[1] != -1 && fds[1] != pipe_fds[1])
+			close(pipe_fds[1]);
+		prev_read = pipe_fds[0];
+	}
+	if (prev_read != -1)
+		close(prev_read);
+	return num_pids;
+}
+
+/* Opens a redirection target, reporting an error if it can't be opened.
+ *
+ * @param filename file named after the redirection operator
+ * @param flags open flags
+ * @return file descriptor, or -1 if the file could not be opened
  */
-void background_handler(char *argv[]) {
+int open_redirect(char *filename, int flags) {
+	int fd = open(filename, flags, 0644);
+	if (fd == -1)
+		printf("Error: cannot open %s: %s\n", filename, strerror(errno));
+	else
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+/* Launches one command with the given descriptors as its stdin, stdout and
+ * stderr.  The program is found through the command path cache and started
+ * with posix_spawn, which doesn't copy the shell's address space; if it
+ * cannot create the process at all (rather than failing to run the program),
+ * the command is retried with fork + execv.  Like execvp, an executable the
+ * kernel won't run (no #! line) is handed to SCRIPTSHELL as a script.
+ *
+ * @param argv command and its arguments
+ * @param fds descriptors for fds 0, 1 and 2, or -1 to inherit the shell's
+ * @param pgid process group to join, 0 to start a new one, -1 to stay in the
+ * 		shell's
+ * @return process ID of the child, or -1 if it could not be started
+ */
+pid_t spawn_stage(char *argv[], int fds[3], pid_t pgid) {
 	pid_t pid;
+	char *path = lookup_command(argv[0]);
 
-	pid = fork();
-	if(pid == 0) {
-		if (execvp(argv[0], argv) == -1) {
+	if (path == NULL) {
+		printf("Error: Invalid command: %s\n", argv[0]);
+		return -1;
+	}
+	if (!use_fork) {
+		posix_spawn_file_actions_t actions;
+		posix_spawnattr_t attr;
+		sigset_t empty, defaults;
+		short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+
+		posix_spawn_file_actions_init(&actions);
+		for (int fd = 0; fd < 3; fd++) {
+			if (fds[fd] != -1)
+				posix_spawn_file_actions_adddup2(&actions, fds[fd], fd);
+		}
+		// The shell may have SIGCHLD blocked and the job control signals
+		// ignored; the child should have neither
+		posix_spawnattr_init(&attr);
+		sigemptyset(&empty);
+		posix_spawnattr_setsigmask(&attr, &empty);
+		shell_signals(&defaults);
+		posix_spawnattr_setsigdefault(&attr, &defaults);
+		if (pgid >= 0) {
+			posix_spawnattr_setpgroup(&attr, pgid);
+			flags |= POSIX_SPAWN_SETPGROUP;
+		}
+		posix_spawnattr_setflags(&attr, flags);
+		int err = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+		if (err == ENOENT && path != argv[0]) {
+			// Moved or deleted since it was cached: look it up again
+			forget_command(argv[0]);
+			path = lookup_command(argv[0]);
+			err = path == NULL ? ENOENT : posix_spawn(&pid, path, &actions, &attr, argv, environ);
+		}
+		if (err == ENOEXEC) {
+			char **sh_argv = script_argv(path, argv);
+			err = posix_spawn(&pid, SCRIPTSHELL, &actions, &attr, sh_argv, environ);
+			free(sh_argv);
+		}
+		posix_spawnattr_destroy(&attr);
+		posix_spawn_file_actions_destroy(&actions);
+		if (err == 0)
+			return pid;
+		if (err == ENOENT || err == EACCES || err == ENOEXEC || err == ENOTDIR) {
 			printf("Error: Invalid command: %s\n", argv[0]);
-			exit(1);
+			return -1;
 		}
 	}
+
+	pid = fork();
+	if (pid == 0) {
+		sigset_t empty, defaults;
+		sigemptyset(&empty);
+		sigprocmask(SIG_SETMASK, &empty, NULL);
+		shell_signals(&defaults);
+		for (int sig = 1; sig < NSIG; sig++) {
+			if (sigismember(&defaults, sig) == 1)
+				signal(sig, SIG_DFL);
+		}
+		if (pgid >= 0)
+			setpgid(0, pgid);
+		for (int fd = 0; fd < 3; fd++) {
+			if (fds[fd] != -1)
+				dup2(fds[fd], fd);
+		}
+		execv(path, argv);
+		if (errno == ENOEXEC)
+			execv(SCRIPTSHELL, script_argv(path, argv));
+		printf("Error: Invalid command: %s\n", argv[0]);
+		fflush(stdout);
+		_exit(1);
+	}
 	else if (pid < 0) {
 		printf("Error: Forking error.\n");
-		exit(1);
+		return -1;
+	}
+	// Also set from this side so the group exists before we use it
+	if (pgid >= 0)
+		setpgid(pid, pgid == 0 ? pid : pgid);
+	return pid;
+}
+
+/* Builds the arguments for running path as a shell script: SCRIPTSHELL,
+ * path, then the command's own arguments.
+ *
+ * @param path file the command runs
+ * @param argv command and its arguments
+ * @return NULL-terminated argument array, to be freed by the caller
+ */
+char **script_argv(char *path, char *argv[]) {
+	int argc = 0;
+	while (argv[argc] != NULL)
+		argc++;
+	char **sh_argv = malloc((argc + 2) * sizeof(char *));
+	sh_argv[0] = SCRIPTSHELL;
+	sh_argv[1] = path;
+	for (int i = 1; i <= argc; i++)
+		sh_argv[i + 1] = argv[i];
+	return sh_argv;
+}
+
+/* Fills in the set of signals the shell handles or ignores itself, which its
+ * children must get back at their default dispositions.
+ *
+ * @param set set to fill in
+ */
+void shell_signals(sigset_t *set) {
+	sigemptyset(set);
+	sigaddset(set, SIGCHLD);
+	sigaddset(set, SIGINT);
+	sigaddset(set, SIGQUIT);
+	sigaddset(set, SIGTSTP);
+	sigaddset(set, SIGTTIN);
+	sigaddset(set, SIGTTOU);
+}
+
+/* Finds the file a command name runs, the way execvp would, but remembers
+ * the answer so that each name's $PATH walk happens once.  Names containing
+ * a '/' are used as they are.  The cache is emptied whenever $PATH is
+ * different from when it was filled.
+ *
+ * @param name command name
+ * @return path of the program (valid until the cache is next changed), or
+ * 		NULL if no directory in $PATH has it
+ */
+char *lookup_command(char *name) {
+	if (strchr(name, '/') != NULL)
+		return name;
+
+	char *path_var = getenv("PATH");
+	if (path_var == NULL)
+		path_var = "/usr/bin:/bin";
+	if (cached_path_var == NULL || strcmp(cached_path_var, path_var) != 0) {
+		clear_path_cache();
+		cached_path_var = strdup(path_var);
+	}
+
+	unsigned int slot = find_path_slot(name);
+	if (path_cache[slot].name != NULL) {
+		path_cache[slot].hits++;
+		return path_cache[slot].path;
+	}
+
+	char *path = search_path(name, path_var);
+	if (path == NULL)
+		return NULL;
+	if ((path_cache_count + 1) * 2 > PATHSLOTS) {
+		// Full enough that probes get long; start over rather than grow
+		clear_path_cache();
+		cached_path_var = strdup(path_var);
+		slot = find_path_slot(name);
+	}
+	path_cache[slot].name = strdup(name);
+	path_cache[slot].path = path;
+	path_cache[slot].hits = 1;
+	path_cache_count++;
+	return path;
+}
+
+/* Walks the directories in a $PATH value looking for an executable file.  An
+ * empty entry means the current directory.
+ *
+ * @param name command name
+ * @param path_var value of $PATH
+ * @return malloc'd path of the program, or NULL if there is none
+ */
+char *search_path(char *name, char *path_var) {
+	char candidate[MAXLINE];
+	struct stat st;
+	char *dir = path_var;
+
+	while (1) {
+		int len = strcspn(dir, ":");
+		if (len == 0)
+			snprintf(candidate, sizeof(candidate), "%s", name);
+		else
+			snprintf(candidate, sizeof(candidate), "%.*s/%s", len, dir, name);
+		if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0)
+			return strdup(candidate);
+		if (dir[len] == '\0')
+			return NULL;
+		dir += len + 1;
+	}
+}
+
+/* Finds the cache slot holding name, or the empty slot where it would go.
+ *
+ * @param name command name
+ * @return slot index
+ */
+unsigned int find_path_slot(char *name) {
+	unsigned int hash = 2166136261u;
+	for (char *c = name; *c != '\0'; c++)
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	unsigned int slot = hash & (PATHSLOTS - 1);
+	while (path_cache[slot].name != NULL && strcmp(path_cache[slot].name, name) != 0)
+		slot = (slot + 1) & (PATHSLOTS - 1);
+	return slot;
+}
+
+/* Empties the command path cache.
+ */
+void clear_path_cache() {
+	for (int i = 0; i < PATHSLOTS; i++) {
+		free(path_cache[i].name);
+		free(path_cache[i].path);
+		path_cache[i].name = NULL;
+		path_cache[i].path = NULL;
 	}
+	path_cache_count = 0;
+	free(cached_path_var);
+	cached_path_var = NULL;
 }
 
-/* Reaps child processes from commands run in the background
+/* Drops one command from the cache, e.g. after its program has gone away.
+ * Later entries in the probe run are reinserted so lookups still find them.
+ *
+ * @param name command name
+ */
+void forget_command(char *name) {
+	unsigned int slot = find_path_slot(name);
+	if (path_cache[slot].name == NULL)
+		return;
+	free(path_cache[slot].name);
+	free(path_cache[slot].path);
+	path_cache[slot].name = NULL;
+	path_cache[slot].path = NULL;
+	path_cache_count--;
+	for (slot = (slot + 1) & (PATHSLOTS - 1); path_cache[slot].name != NULL;
+			slot = (slot + 1) & (PATHSLOTS - 1)) {
+		PathEntry entry = path_cache[slot];
+		path_cache[slot].name = NULL;
+		path_cache[find_path_slot(entry.name)] = entry;
+	}
+}
+
+/* Returns 1 if any $PATH entry is relative (including an empty entry, which
+ * means the current directory), so that 'cd' changes what it finds.
+ */
+int path_has_relative_dirs() {
+	char *dir = cached_path_var;
+	while (dir != NULL) {
+		if (dir[0] != '/')
+			return 1;
+		dir = strchr(dir, ':');
+		if (dir != NULL)
+			dir++;
+	}
+	return 0;
+}
+
+/* Builtin 'hash': with no arguments lists the cached commands with how many
+ * times each was used; 'hash -r' empties the cache; 'hash name...' looks
+ * the names up now and caches them.
+ *
+ * @param argv the builtin's command line
+ */
+void hash_builtin(char *argv[]) {
+	if (argv[1] == NULL) {
+		if (path_cache_count == 0) {
+			printf("hash: cache is empty\n");
+			return;
+		}
+		printf("hits\tcommand\n");
+		for (int i = 0; i < PATHSLOTS; i++) {
+			if (path_cache[i].name != NULL)
+				printf("%4u\t%s\n", path_cache[i].hits, path_cache[i].path);
+		}
+	}
+	else if (strcmp(argv[1], "-r") == 0)
+		clear_path_cache();
+	else {
+		for (int i = 1; argv[i] != NULL; i++) {
+			char *path = lookup_command(argv[i]);
+			if (path == NULL)
+				printf("hash: %s: not found\n", argv[i]);
+			else if (path != argv[i])
+				path_cache[find_path_slot(argv[i])].hits--; // not a use
+		}
+	}
+}
+
+/* Builtin 'parallel [-j N] [-k] [--tag] [-a file] command [args...] [::: arg...]':
+ * runs command once per argument, keeping up to N (default: the number of
+ * CPUs) running at a time.  Each argument replaces '{}' in the command, or
+ * is appended if there is no '{}'.  Arguments come after ':::', or one per
+ * line from file or, failing both, from stdin.
+ *
+ * Each command's stdout is collected through a pipe and printed in one piece
+ * when it finishes, so outputs never interleave: in finishing order, or in
+ * argument order with -k.  --tag starts each output line with the argument.
+ * A summary of the run time and throughput goes to stderr at the end.
+ *
+ * @param argv the builtin's command line
+ */
+void parallel_builtin(char *argv[]) {
+	int max_jobs = sysconf(_SC_NPROCESSORS_ONLN), keep_order = 0, tag = 0;
+	char *arg_file = NULL;
+	int i = 1;
+
+	for (; argv[i] != NULL && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-j") == 0 && argv[i + 1] != NULL)
+			max_jobs = strtol(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-a") == 0 && argv[i + 1] != NULL)
+			arg_file = argv[++i];
+		else if (strcmp(argv[i], "-k") == 0)
+			keep_order = 1;
+		else if (strcmp(argv[i], "--tag") == 0)
+			tag = 1;
+		else
+			break;
+	}
+	char **command = &argv[i];
+	int command_len = 0;
+	while (command[command_len] != NULL && strcmp(command[command_len], ":::") != 0)
+		command_len++;
+	if (command_len == 0 || max_jobs < 1) {
+		printf("usage: parallel [-j N] [-k] [--tag] [-a file] command [args...] [::: arg...]\n");
+		return;
+	}
+
+	// Collect the arguments (copied, since parseArguments reuses its buffer)
+	char **args = NULL;
+	int num_args = 0, args_cap = 0;
+	if (command[command_len] != NULL) {
+		for (char **a = &command[command_len + 1]; *a != NULL; a++)
+			parallel_add_arg(&args, &num_args, &args_cap, *a, strlen(*a));
+	}
+	else {
+		FILE *in = arg_file == NULL ? stdin : fopen(arg_file, "re");
+		char *line = NULL;
+		size_t line_cap = 0;
+		ssize_t len;
+		if (in == NULL) {
+			printf("Error: cannot open %s\n", arg_file);
+			return;
+		}
+		while ((len = getline(&line, &line_cap, in)) != -1) {
+			while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+				len--;
+			if (len > 0)
+				parallel_add_arg(&args, &num_args, &args_cap, line, len);
+		}
+		free(line);
+		if (in == stdin)
+			clearerr(stdin);
+		else
+			fclose(in);
+	}
+
+	ParallelTask *tasks = calloc(num_args > 0 ? num_args : 1, sizeof(ParallelTask));
+	struct pollfd *pollfds = malloc((max_jobs + 1) * sizeof(struct pollfd));
+	int *running = malloc(max_jobs * sizeof(int));
+	int num_running = 0, next_arg = 0, next_print = 0, failed = 0, stop = 0;
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	while ((next_arg < num_args && !stop) || num_running > 0) {
+		while (num_running < max_jobs && next_arg < num_args && !stop) {
+			ParallelTask *task = &tasks[next_arg++];
+			if (parallel_start(task, command, command_len, args[task - tasks]) == -1) {
+				task->done = 1;
+				failed++;
+				continue;
+			}
+			running[num_running++] = task - tasks;
+		}
+		if (num_running == 0)
+			break;
+
+		int num_fds = 0;
+		for (int r = 0; r < num_running; r++) {
+			if (tasks[running[r]].out_fd != -1) {
+				pollfds[num_fds].fd = tasks[running[r]].out_fd;
+				pollfds[num_fds].events = POLLIN;
+				num_fds++;
+			}
+		}
+		pollfds[num_fds].fd = sigchld_pipe[0];
+		pollfds[num_fds].events = POLLIN;
+		if (poll(pollfds, num_fds + 1, -1) == -1 && errno != EINTR)
+			break;
+
+		// Read whatever output is ready, then check which commands exited
+		for (int r = 0; r < num_running; r++) {
+			ParallelTask *task = &tasks[running[r]];
+			if (task->out_fd != -1)
+				parallel_read(task);
+		}
+		char buf[64];
+		while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+			;
+		for (int r = 0; r < num_running; r++) {
+			ParallelTask *task = &tasks[running[r]];
+			int status;
+			if (task->pid > 0 && waitpid(task->pid, &status, WNOHANG) == task->pid) {
+				task->pid = 0;
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+					failed++;
+				if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+					stop = 1;     // ^C: let the rest finish, start no more
+			}
+			if (task->pid == 0 && task->out_fd == -1) {
+				task->done = 1;
+				running[r--] = running[--num_running];
+				if (!keep_order)
+					parallel_print(task, args[task - tasks], tag);
+			}
+		}
+		while (keep_order && next_print < next_arg && tasks[next_print].done) {
+			parallel_print(&tasks[next_print], args[next_print], tag);
+			next_print++;
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+	fflush(stdout);
+	fprintf(stderr, "parallel: %d jobs, %d failed, %.3f s, %.1f jobs/s with -j %d\n",
+			next_arg, failed, secs, secs > 0 ? next_arg / secs : 0, max_jobs);
+	for (int t = 0; t < num_args; t++) {
+		free(tasks[t].output);
+		free(args[t]);
+	}
+	free(tasks);
+	free(args);
+	free(pollfds);
+	free(running);
+}
+
+/* Adds a copy of an argument to the list for 'parallel'.
+ */
+void parallel_add_arg(char ***args, int *num_args, int *args_cap, const char *arg, size_t len) {
+	if (*num_args == *args_cap) {
+		*args_cap = *args_cap == 0 ? 64 : *args_cap * 2;
+		*args = realloc(*args, *args_cap * sizeof(char *));
+	}
+	(*args)[*num_args] = strndup(arg, len);
+	(*num_args)++;
+}
+
+/* Starts one 'parallel' command with its stdout going into a pipe.
+ *
+ * @param task filled in with the process and the pipe's read end
+ * @param command the command's words, '{}' standing for the argument
+ * @param command_len number of words
+ * @param arg this task's argument
+ * @return 0 on success, -1 if the command could not be started
+ */
+int parallel_start(ParallelTask *task, char **command, int command_len, char *arg) {
+	char *task_argv[MAXARGS + 1];
+	int n = 0, substituted = 0;
+	int pipe_fds[2];
+
+	for (int i = 0; i < command_len && n < MAXARGS - 1; i++) {
+		if (strstr(command[i], "{}") == NULL) {
+			task_argv[n++] = command[i];
+			continue;
+		}
+		// Replace every {} in the word; the copy is freed below
+		char word[MAXLINE] = "";
+		const char *rest = command[i], *brace;
+		while ((brace = strstr(rest, "{}")) != NULL) {
+			snprintf(word + strlen(word), sizeof(word) - strlen(word), "%.*s%s",
+					(int)(brace - rest), rest, arg);
+			rest = brace + 2;
+		}
+		snprintf(word + strlen(word), sizeof(word) - strlen(word), "%s", rest);
+		task_argv[n++] = strdup(word);
+		substituted = 1;
+	}
+	if (!substituted)
+		task_argv[n++] = arg;
+	task_argv[n] = NULL;
+
+	if (pipe(pipe_fds) == -1) {
+		printf("Error: cannot create pipe.\n");
+		return -1;
+	}
+	fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipe_fds[1], F_SETFD, FD_CLOEXEC);
+	int fds[3] = {-1, pipe_fds[1], -1};
+	task->pid = spawn_stage(task_argv, fds, -1);
+	close(pipe_fds[1]);
+	for (int i = 0; i < command_len && i < n; i++) {
+		if (task_argv[i] != command[i])
+			free(task_argv[i]);
+	}
+	if (task->pid <= 0) {
+		close(pipe_fds[0]);
+		return -1;
+	}
+	task->out_fd = pipe_fds[0];
+	return 0;
+}
+
+/* Reads what is available from a 'parallel' command's stdout pipe into its
+ * output buffer, closing the pipe at end of file.
+ */
+void parallel_read(ParallelTask *task) {
+	struct pollfd pfd = {task->out_fd, POLLIN, 0};
+	if (poll(&pfd, 1, 0) <= 0)
+		return;
+	if (task->len + 65536 > task->cap) {
+		task->cap = task->cap == 0 ? 65536 : task->cap * 2;
+		task->output = realloc(task->output, task->cap);
+	}
+	ssize_t got = read(task->out_fd, task->output + task->len, task->cap - task->len);
+	if (got > 0)
+		task->len += got;
+	else if (got == 0 || errno != EINTR) {
+		close(task->out_fd);
+		task->out_fd = -1;
+	}
+}
+
+/* Prints a finished 'parallel' command's collected output.
+ *
+ * @param task the finished command
+ * @param arg its argument, used as the tag
+ * @param tag 1 to start every line with the argument and a tab
+ */
+void parallel_print(ParallelTask *task, char *arg, int tag) {
+	if (!tag) {
+		fwrite(task->output, 1, task->len, stdout);
+		return;
+	}
+	size_t at = 0;
+	while (at < task->len) {
+		char *eol = memchr(task->output + at, '\n', task->len - at);
+		size_t line_len = eol == NULL ? task->len - at : (size_t)(eol - task->output - at);
+		printf("%s\t%.*s\n", arg, (int)line_len, task->output + at);
+		at += line_len + 1;
+	}
+}
+
+/* Builtin 'spawnbench [-n count] [-m MB] command [args...]': runs the command
+ * count times (default 200) with posix_spawn and then with fork, after
+ * growing the shell by MB megabytes of touched memory to imitate a large
+ * shell, and prints the average launch-and-wait time of each.  The
+ * command's output goes to /dev/null.
+ *
+ * @param argv the builtin's command line
+ */
+void spawn_bench(char *argv[]) {
+	int count = 200, megabytes = 0, i = 1;
+	char *ballast = NULL;
+
+	for (; argv[i] != NULL && argv[i][0] == '-' && argv[i + 1] != NULL; i += 2) {
+		if (strcmp(argv[i], "-n") == 0)
+			count = strtol(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-m") == 0)
+			megabytes = strtol(argv[i + 1], NULL, 10);
+		else
+			break;
+	}
+	if (argv[i] == NULL || count < 1) {
+		printf("usage: spawnbench [-n count] [-m MB] command [args...]\n");
+		return;
+	}
+	if (megabytes > 0) {
+		ballast = malloc((size_t)megabytes << 20);
+		if (ballast == NULL) {
+			printf("Error: cannot allocate %d MB\n", megabytes);
+			return;
+		}
+		memset(ballast, 1, (size_t)megabytes << 20);
+	}
+
+	int fds[3] = {-1, open("/dev/null", O_WRONLY), -1};
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	sigset_t mask, old_mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &old_mask);
+	printf("%d runs of %s with %d MB of extra shell memory\n", count, argv[i], megabytes);
+	for (int method = 0; method < 2; method++) {
+		struct timeval start, end;
+		use_fork = method;
+		gettimeofday(&start, NULL);
+		for (int run = 0; run < count; run++) {
+			int status;
+			pid_t pid = spawn_stage(&argv[i], fds, -1);
+			if (pid < 0)
+				break;
+			waitpid(pid, &status, 0);
+		}
+		gettimeofday(&end, NULL);
+		double usecs = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_usec - start.tv_usec);
+		printf("%-12s %10.1f us per command\n", method ? "fork" : "posix_spawn", usecs / count);
+	}
+	use_fork = 0;
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+	close(fds[1]);
+	free(ballast);
+}
+
+/* Handles SIGCHLD.  The handler only writes a byte to the self-pipe, which is
+ * async-signal-safe; the children are reaped and reported from the main loop
+ * by reap_children.
  *
  * @param sig UNUSED PARAMETER
  */
 void child_handler(__attribute__ ((unused)) int sig){
+	int saved_errno = errno;
+	// The pipe is non-blocking: if it is full a wakeup is already pending
+	if (write(sigchld_pipe[1], "", 1) == -1) { }
+	errno = saved_errno;
+}
+
+/* Reaps every child that has exited, stopped or continued without blocking
+ * and records it in its job.  Drains the self-pipe first, so a SIGCHLD that
+ * arrives while we reap just causes another (harmless) pass later.
+ */
+void reap_children() {
+	char buf[64];
 	pid_t pid;
 	int status;
-	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-		printf("reaped child %d\n", pid);
+	struct rusage usage;
+
+	while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+		;
+	while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0)
+		update_job(pid, status, &usage);
+}
+
+/* Records a status change reported by wait4 for one of a job's processes.
+ * CPU times are summed over the job's processes and max RSS is the largest
+ * of them.
+ *
+ * @param pid process whose status changed
+ * @param status status from wait4
+ * @param usage resource usage from wait4 (only used when the process exited)
+ */
+void update_job(pid_t pid, int status, struct rusage *usage) {
+	for (int j = 0; j < MAXJOBS; j++) {
+		Job *job = &jobs[j];
+		for (int i = 0; job->id != 0 && i < job->num_pids; i++) {
+			if (job->pids[i] != pid)
+				continue;
+			if (WIFSTOPPED(status))
+				job->stopped[i] = 1;
+			else if (WIFCONTINUED(status))
+				job->stopped[i] = 0;
+			else {
+				job->stopped[i] = 0;
+				job->exited[i] = 1;
+				job->num_live--;
+				if (i == job->num_pids - 1)
+					job->status = status;
+				timeradd(&job->usage.ru_utime, &usage->ru_utime, &job->usage.ru_utime);
+				timeradd(&job->usage.ru_stime, &usage->ru_stime, &job->usage.ru_stime);
+				if (usage->ru_maxrss > job->usage.ru_maxrss)
+					job->usage.ru_maxrss = usage->ru_maxrss;
+			}
+
+			int any_stopped = 0, all_stopped = 1;
+			for (int k = 0; k < job->num_pids; k++) {
+				if (!job->exited[k]) {
+					any_stopped |= job->stopped[k];
+					all_stopped &= job->stopped[k];
+				}
+			}
+			if (job->num_live == 0) {
+				job->state = JOB_DONE;
+				clock_gettime(CLOCK_MONOTONIC, &job->end);
+			}
+			else if (any_stopped && all_stopped)
+				job->state = JOB_STOPPED;
+			else
+				job->state = JOB_RUNNING;
+			return;
+		}
+	}
+}
+
+/* Prints a line for each background job that finished or stopped since the
+ * last report, and frees the slots of finished jobs.
+ */
+void report_jobs() {
+	for (int j = 0; j < MAXJOBS; j++) {
+		Job *job = &jobs[j];
+		if (job->id == 0 || job->state == job->reported)
+			continue;
+		if (job->state == JOB_DONE) {
+			printf("[%d]  Done\t\t%s\n", job->id, job->cmdline);
+			if (job->timed)
+				print_usage(job);
+			job->id = 0;
+		}
+		else if (job->state == JOB_STOPPED)
+			printf("[%d]  Stopped\t\t%s\n", job->id, job->cmdline);
+		job->reported = job->state;
+	}
+}
+
+/* Finds a free slot in the job table for a job about to be started.  The
+ * slot stays free until add_job fills it in.
+ *
+ * @return the slot, or NULL (after printing an error) if the table is full
+ */
+Job *reserve_job() {
+	for (int j = 0; j < MAXJOBS; j++) {
+		if (jobs[j].id == 0)
+			return &jobs[j];
+	}
+	printf("Error: too many jobs.\n");
+	return NULL;
+}
+
+/* Fills in a slot from reserve_job with the processes just started.
+ *
+ * @param slot the reserved slot
+ * @param pids process IDs of the job's commands, in pipeline order
+ * @param num_pids number of processes
+ * @param pgid process group of the job, or 0 if it shares the shell's
+ * @param cmdline command line that started the job
+ * @param timed 1 if the job's resource usage should be printed when it ends
+ * @param start when the job started, taken before its first process was spawned
+ */
+void add_job(Job *slot, pid_t pids[], int num_pids, pid_t pgid, char *cmdline, int timed,
+		struct timespec *start) {
+	int id = 0;
+	for (int j = 0; j < MAXJOBS; j++) {
+		if (jobs[j].id > id)
+			id = jobs[j].id;
 	}
+
+	memset(slot, 0, sizeof(Job));
+	slot->id = id + 1;
+	slot->pgid = pgid;
+	memcpy(slot->pids, pids, num_pids * sizeof(pid_t));
+	slot->num_pids = num_pids;
+	slot->num_live = num_pids;
+	slot->state = slot->reported = num_pids > 0 ? JOB_RUNNING : JOB_DONE;
+	slot->status = 127 << 8;    // as if exit(127), for a command that never ran
+	slot->timed = timed;
+	slot->start = *start;
+	clock_gettime(CLOCK_MONOTONIC, &slot->end);  // for a job with no processes
+	snprintf(slot->cmdline, MAXLINE, "%s", cmdline);
+	slot->cmdline[strcspn(slot->cmdline, "\n")] = '\0';
+}
+
+/* Finds a job from a 'fg'/'bg' argument: "%n" or "n" for job n, or the most
+ * recent job when there is no argument.
+ *
+ * @param arg the builtin's argument, or NULL
+ * @return the job, or NULL (after printing an error) if there is none
+ */
+Job *find_job(char *arg) {
+	Job *found = NULL;
+	int id = arg == NULL ? 0 : strtol(arg[0] == '%' ? arg + 1 : arg, NULL, 10);
+	for (int j = 0; j < MAXJOBS; j++) {
+		if (jobs[j].id == 0 || jobs[j].state == JOB_DONE)
+			continue;
+		if (id != 0 ? jobs[j].id == id : (found == NULL || jobs[j].id > found->id))
+			found = &jobs[j];
+	}
+	if (found == NULL)
+		printf("Error: no such job%s%s\n", arg == NULL ? "" : " ", arg == NULL ? "" : arg);
+	return found;
+}
+
+/* Sends a signal to every process of a job.
+ *
+ * @param job job to signal
+ * @param sig signal to send
+ */
+void signal_job(Job *job, int sig) {
+	if (job->pgid > 0)
+		kill(-job->pgid, sig);
+	else {
+		for (int i = 0; i < job->num_pids; i++) {
+			if (!job->exited[i])
+				kill(job->pids[i], sig);
+		}
+	}
+}
+
+/* Waits, with the terminal handed to the job, until a foreground job has
+ * finished or stopped.  A finished job's slot is freed after printing its
+ * resource usage if it was timed.
+ *
+ * @param job job to wait for
+ */
+void wait_for_job(Job *job) {
+	pid_t pid;
+	int status;
+	struct rusage usage;
+
+	if (interactive && job->pgid > 0) {
+		tcsetpgrp(STDIN_FILENO, job->pgid);
+		// In case a command read the terminal before it was handed over
+		kill(-job->pgid, SIGCONT);
+	}
+	while (job->state == JOB_RUNNING) {
+		pid = wait4(-1, &status, WUNTRACED, &usage);
+		if (pid > 0)
+			update_job(pid, status, &usage);
+		else if (errno != EINTR)
+			break;
+	}
+	if (interactive)
+		tcsetpgrp(STDIN_FILENO, shell_pgid);
+
+	if (job->state == JOB_STOPPED) {
+		printf("\n[%d]  Stopped\t\t%s\n", job->id, job->cmdline);
+		job->reported = JOB_STOPPED;
+	}
+	else {
+		if (job->timed)
+			print_usage(job);
+		last_status = exit_status(job->status);
+		job->id = 0;
+	}
+}
+
+/* Prints the wall clock time, CPU times and peak memory of a finished job.
+ *
+ * @param job finished job
+ */
+void print_usage(Job *job) {
+	long wall_ms = ((job->end.tv_sec - job->start.tv_sec) * 1000000000L
+		+ (job->end.tv_nsec - job->start.tv_nsec)) / 1000000;
+	printf("\nreal\t%ld.%03lds\n", wall_ms / 1000, wall_ms % 1000);
+	printf("user\t%ld.%03lds\n", (long)job->usage.ru_utime.tv_sec, (long)job->usage.ru_utime.tv_usec / 1000);
+	printf("sys\t%ld.%03lds\n", (long)job->usage.ru_stime.tv_sec, (long)job->usage.ru_stime.tv_usec / 1000);
+	printf("maxrss\t%ld KB\n", job->usage.ru_maxrss);
+}
+
+/* Builtin 'jobs': lists the running and stopped jobs.
+ */
+void print_jobs() {
+	reap_children();
+	for (int j = 0; j < MAXJOBS; j++) {
+		if (jobs[j].id != 0 && jobs[j].state != JOB_DONE)
+			printf("[%d]  %s\t\t%s\n", jobs[j].id,
+					jobs[j].state == JOB_STOPPED ? "Stopped" : "Running", jobs[j].cmdline);
+	}
+	report_jobs();
+}
+
+/* Builtins 'fg' and 'bg': continues a stopped job, in the foreground (waiting
+ * for it) or in the background.
+ *
+ * @param argv the builtin's command line
+ * @param foreground 1 for fg, 0 for bg
+ */
+void continue_job(char *argv[], int foreground) {
+	reap_children();
+	Job *job = find_job(argv[1]);
+	if (job == NULL)
+		return;
+	printf("%s\n", job->cmdline);
+	for (int i = 0; i < job->num_pids; i++)
+		job->stopped[i] = 0;
+	job->state = job->reported = JOB_RUNNING;
+	if (foreground) {
+		// wait_for_job sends the SIGCONT once the job has the terminal
+		if (!interactive || job->pgid <= 0)
+			signal_job(job, SIGCONT);
+		wait_for_job(job);
+	}
+	else
+		signal_job(job, SIGCONT);
 }
 
 /* Runs a specified command from the history with the corresponding ID that is
- * contained in old_cmd
+ * contained in old_cmd, or the most recent command starting with the text
+ * after the '!'
  *
- * @param old_cmd user's '!num' command
+ * @param old_cmd user's '!num' or '!text' command
  * @return returns the string command corresponding to the specified ID, NULL if command cannot
  * 		be found int the history
  */
 char *run_history(char *old_cmd) {
 	old_cmd++;
 
-	int hist_id = strtol(old_cmd, NULL, 10);
-	char *new_cmd = find_cmd(hist_id);
+	char *new_cmd;
+	if (old_cmd[0] >= '0' && old_cmd[0] <= '9')
+		new_cmd = find_cmd(strtol(old_cmd, NULL, 10));
+	else {
+		char prefix[MAXLINE];
+		snprintf(prefix, sizeof(prefix), "%.*s", (int)strcspn(old_cmd, "\n"), old_cmd);
+		new_cmd = prefix[0] == '\0' ? NULL : find_prefix(prefix);
+	}
 	if (new_cmd == NULL) {
 		printf("Error: command does not exist in history\n");
 		return NULL;
@@ -198,3 +1560,27 @@ char *run_history(char *old_cmd) {
 		return new_cmd;
 	}
 }
+
+/* Builtin 'history': with no arguments prints the most recent commands, and
+ * with '-s pattern' prints every saved command containing the pattern (the
+ * words of the pattern are rejoined with single spaces).
+ *
+ * @param argv the builtin's command line
+ */
+void history_builtin(char *argv[]) {
+	if (argv[1] == NULL) {
+		print_history();
+		return;
+	}
+	if (strcmp(argv[1], "-s") != 0 || argv[2] == NULL) {
+		printf("usage: history [-s pattern]\n");
+		return;
+	}
+	char pattern[MAXLINE] = "";
+	for (int i = 2; argv[i] != NULL; i++) {
+		if (i > 2)
+			strncat(pattern, " ", MAXLINE - strlen(pattern) - 1);
+		strncat(pattern, argv[i], MAXLINE - strlen(pattern) - 1);
+	}
+	search_history(pattern);
+}